@@ -0,0 +1,318 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Scott Shawcroft for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "host/dmac_model.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "samd/dma.h"
+#include "samd/events.h"
+
+#include "py/mphal.h"
+#include "shared-bindings/microcontroller/__init__.h"
+
+Dmac dmac_model_dmac;
+Sercom dmac_model_sercoms[SERCOM_INST_NUM];
+Qspi dmac_model_qspi;
+Mclk dmac_model_mclk;
+DWT_Type dmac_model_dwt;
+CoreDebug_Type dmac_model_core_debug;
+
+static uint8_t channel_priority[DMA_CHANNEL_COUNT];
+// The descriptor each channel will move next, like the DMAC's own fetch pointer.
+static DmacDescriptor* next_descriptor[DMA_CHANNEL_COUNT];
+static uint8_t interrupts_disabled;
+static bool in_interrupt;
+
+static DmacDescriptor* descriptor_at(uint32_t address) {
+    return (DmacDescriptor*) (uintptr_t) address;
+}
+
+bool dmac_model_address_ok(const volatile void* address) {
+    return (uintptr_t) address == (uint32_t) (uintptr_t) address;
+}
+
+// Recompute INTSTATUS and call the handler once if a channel is asking for it and interrupts are on.
+static void dmac_model_update_interrupt(void) {
+    uint32_t pending = 0;
+    for (uint8_t i = 0; i < DMA_CHANNEL_COUNT; i++) {
+        DmacChannel* channel = &DMAC->Channel[i];
+        if ((channel->CHINTFLAG.reg & channel->CHINTENSET.reg) != 0) {
+            pending |= 1u << i;
+        }
+    }
+    DMAC->INTSTATUS.reg = pending;
+    if (pending == 0 || interrupts_disabled > 0 || in_interrupt) {
+        return;
+    }
+    in_interrupt = true;
+    // All five DMAC lines go to the same handler.
+    DMAC_0_Handler();
+    in_interrupt = false;
+}
+
+void dmac_model_reset(void) {
+    memset(&dmac_model_dmac, 0, sizeof(dmac_model_dmac));
+    memset(dmac_model_sercoms, 0, sizeof(dmac_model_sercoms));
+    memset(next_descriptor, 0, sizeof(next_descriptor));
+    interrupts_disabled = 0;
+    in_interrupt = false;
+}
+
+static void dmac_model_set_flags(uint8_t channel_number, uint8_t flags) {
+    DMAC->Channel[channel_number].CHINTFLAG.reg |= flags;
+    dmac_model_update_interrupt();
+}
+
+bool dmac_model_run_block(uint8_t channel_number) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    if (!channel->CHCTRLA.bit.ENABLE) {
+        return false;
+    }
+    DmacDescriptor* descriptor = next_descriptor[channel_number];
+    if (descriptor == NULL) {
+        descriptor = descriptor_at(DMAC->BASEADDR.reg) + channel_number;
+    }
+    if (!descriptor->BTCTRL.bit.VALID) {
+        // Fetching an invalid descriptor is a transfer error.
+        channel->CHSTATUS.bit.FERR = 1;
+        dmac_model_error(channel_number);
+        return false;
+    }
+
+    // The SERCOMs never receive anything. Software only writes RXC and ERROR to clear them but RAM
+    // keeps what was written so take them back out.
+    for (uint8_t s = 0; s < SERCOM_INST_NUM; s++) {
+        dmac_model_sercoms[s].SPI.INTFLAG.reg &= ~(SERCOM_SPI_INTFLAG_RXC | SERCOM_SPI_INTFLAG_ERROR);
+    }
+
+    uint16_t btctrl = descriptor->BTCTRL.reg;
+    uint32_t beats = descriptor->BTCNT.reg;
+    uint8_t beat_bytes = 1 << descriptor->BTCTRL.bit.BEATSIZE;
+    uint8_t step_shift = descriptor->BTCTRL.bit.STEPSIZE;
+    uint32_t src_step = 0;
+    uint32_t dst_step = 0;
+    if ((btctrl & DMAC_BTCTRL_SRCINC) != 0) {
+        src_step = beat_bytes << ((btctrl & DMAC_BTCTRL_STEPSEL) != 0 ? step_shift : 0);
+    }
+    if ((btctrl & DMAC_BTCTRL_DSTINC) != 0) {
+        dst_step = beat_bytes << ((btctrl & DMAC_BTCTRL_STEPSEL) != 0 ? 0 : step_shift);
+    }
+    // Incrementing addresses are the end of the block.
+    uint32_t src = descriptor->SRCADDR.reg - beats * src_step;
+    uint32_t dst = descriptor->DSTADDR.reg - beats * dst_step;
+    for (uint32_t i = 0; i < beats; i++) {
+        memcpy((void*) (uintptr_t) dst, (const void*) (uintptr_t) src, beat_bytes);
+        for (uint8_t s = 0; s < SERCOM_INST_NUM; s++) {
+            SercomSpi* spi = &dmac_model_sercoms[s].SPI;
+            if (dst == (uint32_t) (uintptr_t) &spi->DATA.reg) {
+                // The byte shifts out straight away.
+                spi->INTFLAG.reg |= SERCOM_SPI_INTFLAG_DRE | SERCOM_SPI_INTFLAG_TXC;
+            }
+        }
+        src += src_step;
+        dst += dst_step;
+    }
+
+    DmacDescriptor* write_back = descriptor_at(DMAC->WRBADDR.reg) + channel_number;
+    *write_back = *descriptor;
+    write_back->BTCNT.reg = 0;
+
+    uint8_t flags = 0;
+    if ((btctrl & DMAC_BTCTRL_BLOCKACT_Msk) == DMAC_BTCTRL_BLOCKACT_INT) {
+        flags = DMAC_CHINTFLAG_TCMPL;
+    }
+    if (descriptor->DESCADDR.reg == 0) {
+        // The channel turns itself off at the end of the chain.
+        channel->CHCTRLA.bit.ENABLE = 0;
+        next_descriptor[channel_number] = NULL;
+        flags = DMAC_CHINTFLAG_TCMPL;
+    } else {
+        next_descriptor[channel_number] = descriptor_at(descriptor->DESCADDR.reg);
+    }
+    if (flags != 0) {
+        dmac_model_set_flags(channel_number, flags);
+    }
+    return channel->CHCTRLA.bit.ENABLE;
+}
+
+void dmac_model_run(uint8_t channel_number) {
+    while (dmac_model_run_block(channel_number)) {
+    }
+}
+
+void dmac_model_error(uint8_t channel_number) {
+    DMAC->Channel[channel_number].CHCTRLA.bit.ENABLE = 0;
+    next_descriptor[channel_number] = NULL;
+    dmac_model_set_flags(channel_number, DMAC_CHINTFLAG_TERR);
+}
+
+// The rest stands in for samd/sam_d5x_e5x/dma.c.
+
+uint8_t sercom_index(Sercom* sercom) {
+    for (uint8_t i = 0; i < SERCOM_INST_NUM; i++) {
+        if (&dmac_model_sercoms[i] == sercom) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+static void dmac_model_reset_channel(DmacChannel* channel) {
+    memset(channel, 0, sizeof(DmacChannel));
+}
+
+void dma_configure(uint8_t channel_number, uint8_t trigsrc, bool output_event) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    dmac_model_reset_channel(channel);
+    if (output_event) {
+        channel->CHEVCTRL.reg = DMAC_CHEVCTRL_EVOE;
+    }
+    channel->CHPRILVL.reg = DMAC_CHPRILVL_PRILVL(channel_priority[channel_number]);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(trigsrc) |
+                           DMAC_CHCTRLA_TRIGACT_BURST |
+                           DMAC_CHCTRLA_BURSTLEN_SINGLE;
+    dmac_model_update_interrupt();
+}
+
+void dma_configure_software(uint8_t channel_number) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    dmac_model_reset_channel(channel);
+    channel->CHPRILVL.reg = DMAC_CHPRILVL_PRILVL(channel_priority[channel_number]);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(0) |
+                           DMAC_CHCTRLA_TRIGACT_TRANSACTION |
+                           DMAC_CHCTRLA_BURSTLEN_SINGLE;
+    dmac_model_update_interrupt();
+}
+
+void dma_configure_event_input(uint8_t channel_number, uint8_t event_action, bool block_per_event) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    if (block_per_event) {
+        channel->CHCTRLA.bit.TRIGACT = DMAC_CHCTRLA_TRIGACT_BLOCK_Val;
+    }
+    channel->CHEVCTRL.reg = (channel->CHEVCTRL.reg & DMAC_CHEVCTRL_EVOE) |
+                            DMAC_CHEVCTRL_EVIE |
+                            DMAC_CHEVCTRL_EVACT(event_action);
+}
+
+void dma_set_channel_priority(uint8_t channel_number, uint8_t level) {
+    if (level >= DMA_PRIORITY_LEVEL_COUNT) {
+        return;
+    }
+    channel_priority[channel_number] = level;
+    DMAC->Channel[channel_number].CHPRILVL.reg = DMAC_CHPRILVL_PRILVL(level);
+}
+
+void dma_enable_channel(uint8_t channel_number) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    channel->CHCTRLA.bit.ENABLE = true;
+    channel->CHINTFLAG.reg = 0;
+    next_descriptor[channel_number] = NULL;
+    dmac_model_update_interrupt();
+}
+
+void dma_disable_channel(uint8_t channel_number) {
+    DMAC->Channel[channel_number].CHCTRLA.bit.ENABLE = false;
+}
+
+void dma_suspend_channel(uint8_t channel_number) {
+    dmac_model_set_flags(channel_number, DMAC_CHINTFLAG_SUSP);
+}
+
+void dma_resume_channel(uint8_t channel_number) {
+    DMAC->Channel[channel_number].CHINTFLAG.reg &= ~DMAC_CHINTFLAG_SUSP;
+    dmac_model_update_interrupt();
+}
+
+bool dma_channel_enabled(uint8_t channel_number) {
+    return DMAC->Channel[channel_number].CHCTRLA.bit.ENABLE;
+}
+
+uint8_t dma_transfer_status(uint8_t channel_number) {
+    return DMAC->Channel[channel_number].CHINTFLAG.reg;
+}
+
+void dma_enable_channel_interrupts(uint8_t channel_number, uint8_t interrupt_flags) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    channel->CHINTENSET.reg |= interrupt_flags;
+    channel->CHINTENCLR.reg = channel->CHINTENSET.reg;
+    dmac_model_update_interrupt();
+}
+
+void dma_disable_channel_interrupts(uint8_t channel_number) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    channel->CHINTENSET.reg = 0;
+    channel->CHINTENCLR.reg = 0;
+    dmac_model_update_interrupt();
+}
+
+void dma_clear_channel_interrupts(uint8_t channel_number, uint8_t interrupt_flags) {
+    DMAC->Channel[channel_number].CHINTFLAG.reg &= ~interrupt_flags;
+    dmac_model_update_interrupt();
+}
+
+bool dma_channel_free(uint8_t channel_number) {
+    return DMAC->Channel[channel_number].CHSTATUS.reg == 0;
+}
+
+// Interrupt masking holds the model's interrupt off until the last enable.
+
+void mp_hal_disable_all_interrupts(void) {
+    interrupts_disabled++;
+}
+
+void mp_hal_enable_all_interrupts(void) {
+    interrupts_disabled--;
+    if (interrupts_disabled == 0) {
+        dmac_model_update_interrupt();
+    }
+}
+
+void common_hal_mcu_disable_interrupts(void) {
+    mp_hal_disable_all_interrupts();
+}
+
+void common_hal_mcu_enable_interrupts(void) {
+    mp_hal_enable_all_interrupts();
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq) {
+    (void) irq;
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq) {
+    (void) irq;
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq) {
+    (void) irq;
+}
+
+void connect_event_user_to_channel(uint8_t user, uint8_t channel) {
+    (void) user;
+    (void) channel;
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Scott Shawcroft for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MICROPY_INCLUDED_ATMEL_SAMD_HOST_DMAC_MODEL_H
+#define MICROPY_INCLUDED_ATMEL_SAMD_HOST_DMAC_MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A register level model of the SAMD51 DMAC so samd/dma.c can run on a host. It takes the place of
+// samd/sam_d5x_e5x/dma.c and gives the channel registers their write-one-to-clear behaviour. Nothing
+// moves until a test calls dmac_model_run_block() or dmac_model_run(), which copy beats the way
+// the descriptors say, set TCMPL and call the DMAC interrupt handler like the NVIC would.
+// Descriptors hold 32-bit addresses so everything the DMAC touches must be static and the program
+// must be linked with -no-pie.
+
+// Clear every register. Call before init_shared_dma().
+void dmac_model_reset(void);
+
+// Move one block of the channel's current descriptor and raise TCMPL if the block asks for it or it
+// was the last one. Returns whether the channel is still enabled afterwards.
+bool dmac_model_run_block(uint8_t channel_number);
+
+// Run blocks until the channel turns itself off. Don't use it on a ring because it never ends.
+void dmac_model_run(uint8_t channel_number);
+
+// End the channel's job with a transfer error.
+void dmac_model_error(uint8_t channel_number);
+
+// Whether address fits in a descriptor.
+bool dmac_model_address_ok(const volatile void* address);
+
+#endif  // MICROPY_INCLUDED_ATMEL_SAMD_HOST_DMAC_MODEL_H
@@ -0,0 +1,399 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Scott Shawcroft for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MICROPY_INCLUDED_ATMEL_SAMD_HOST_SAM_H
+#define MICROPY_INCLUDED_ATMEL_SAMD_HOST_SAM_H
+
+// Stands in for the SAMD51 device header when samd/dma.c is built on a host. Only the registers and
+// fields that samd/dma.c uses are here. The peripherals are plain structs in RAM that
+// host/dmac_model.c owns.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef SAM_D5X_E5X
+#define SAM_D5X_E5X
+#endif
+
+// Core
+
+typedef int IRQn_Type;
+enum {
+    DMAC_0_IRQn = 31,
+    DMAC_1_IRQn = 32,
+    DMAC_2_IRQn = 33,
+    DMAC_3_IRQn = 34,
+    DMAC_4_IRQn = 35,
+};
+
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+
+// The host runs one thread and "interrupts" are calls from the model so exclusive access always
+// succeeds.
+#define __LDREXW(address) (*(address))
+#define __STREXW(value, address) (*(address) = (value), 0)
+#define __CLREX()
+
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+#define DWT_CTRL_CYCCNTENA_Msk (1u << 0)
+
+typedef struct {
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+#define CoreDebug_DEMCR_TRCENA_Msk (1u << 24)
+
+// DMAC
+
+typedef struct {
+    volatile union {
+        struct {
+            uint16_t VALID:1;
+            uint16_t EVOSEL:2;
+            uint16_t BLOCKACT:2;
+            uint16_t :3;
+            uint16_t BEATSIZE:2;
+            uint16_t SRCINC:1;
+            uint16_t DSTINC:1;
+            uint16_t STEPSEL:1;
+            uint16_t STEPSIZE:3;
+        } bit;
+        uint16_t reg;
+    } BTCTRL;
+    volatile union {
+        uint16_t reg;
+    } BTCNT;
+    volatile union {
+        uint32_t reg;
+    } SRCADDR;
+    volatile union {
+        uint32_t reg;
+    } DSTADDR;
+    volatile union {
+        uint32_t reg;
+    } DESCADDR;
+} DmacDescriptor;
+
+#define DMAC_BTCTRL_VALID (1u << 0)
+#define DMAC_BTCTRL_BLOCKACT_Pos 3
+#define DMAC_BTCTRL_BLOCKACT_Msk (0x3u << DMAC_BTCTRL_BLOCKACT_Pos)
+#define DMAC_BTCTRL_BLOCKACT_INT (0x1u << DMAC_BTCTRL_BLOCKACT_Pos)
+#define DMAC_BTCTRL_BEATSIZE_Pos 8
+#define DMAC_BTCTRL_BEATSIZE_Msk (0x3u << DMAC_BTCTRL_BEATSIZE_Pos)
+#define DMAC_BTCTRL_BEATSIZE_BYTE (0x0u << DMAC_BTCTRL_BEATSIZE_Pos)
+#define DMAC_BTCTRL_BEATSIZE_HWORD (0x1u << DMAC_BTCTRL_BEATSIZE_Pos)
+#define DMAC_BTCTRL_BEATSIZE_WORD (0x2u << DMAC_BTCTRL_BEATSIZE_Pos)
+#define DMAC_BTCTRL_SRCINC (1u << 10)
+#define DMAC_BTCTRL_DSTINC (1u << 11)
+#define DMAC_BTCTRL_STEPSEL (1u << 12)
+#define DMAC_BTCTRL_STEPSIZE_Pos 13
+#define DMAC_BTCTRL_STEPSIZE_Msk (0x7u << DMAC_BTCTRL_STEPSIZE_Pos)
+#define DMAC_BTCTRL_STEPSIZE(value) (DMAC_BTCTRL_STEPSIZE_Msk & ((value) << DMAC_BTCTRL_STEPSIZE_Pos))
+
+typedef struct {
+    volatile union {
+        struct {
+            uint32_t SWRST:1;
+            uint32_t ENABLE:1;
+            uint32_t :4;
+            uint32_t RUNSTDBY:1;
+            uint32_t :1;
+            uint32_t TRIGSRC:7;
+            uint32_t :5;
+            uint32_t TRIGACT:2;
+            uint32_t :2;
+            uint32_t BURSTLEN:4;
+            uint32_t THRESHOLD:2;
+            uint32_t :2;
+        } bit;
+        uint32_t reg;
+    } CHCTRLA;
+    volatile union {
+        struct {
+            uint8_t CMD:2;
+            uint8_t :6;
+        } bit;
+        uint8_t reg;
+    } CHCTRLB;
+    volatile union {
+        struct {
+            uint8_t PRILVL:2;
+            uint8_t :6;
+        } bit;
+        uint8_t reg;
+    } CHPRILVL;
+    volatile union {
+        struct {
+            uint8_t EVACT:3;
+            uint8_t :1;
+            uint8_t EVOMODE:2;
+            uint8_t EVIE:1;
+            uint8_t EVOE:1;
+        } bit;
+        uint8_t reg;
+    } CHEVCTRL;
+    volatile union {
+        uint8_t reg;
+    } CHINTENCLR;
+    volatile union {
+        uint8_t reg;
+    } CHINTENSET;
+    volatile union {
+        struct {
+            uint8_t TERR:1;
+            uint8_t TCMPL:1;
+            uint8_t SUSP:1;
+            uint8_t :5;
+        } bit;
+        uint8_t reg;
+    } CHINTFLAG;
+    volatile union {
+        struct {
+            uint8_t PEND:1;
+            uint8_t BUSY:1;
+            uint8_t FERR:1;
+            uint8_t CRCERR:1;
+            uint8_t :4;
+        } bit;
+        uint8_t reg;
+    } CHSTATUS;
+} DmacChannel;
+
+#define DMAC_CHCTRLA_SWRST (1u << 0)
+#define DMAC_CHCTRLA_ENABLE (1u << 1)
+#define DMAC_CHCTRLA_TRIGSRC(value) ((0x7fu & (value)) << 8)
+#define DMAC_CHCTRLA_TRIGACT_BLOCK_Val 0x0u
+#define DMAC_CHCTRLA_TRIGACT_BURST (0x2u << 20)
+#define DMAC_CHCTRLA_TRIGACT_TRANSACTION (0x3u << 20)
+#define DMAC_CHCTRLA_BURSTLEN_SINGLE (0x0u << 24)
+#define DMAC_CHCTRLB_CMD_SUSPEND (0x1u << 0)
+#define DMAC_CHCTRLB_CMD_RESUME (0x2u << 0)
+#define DMAC_CHPRILVL_PRILVL(value) (0x3u & (value))
+#define DMAC_CHEVCTRL_EVACT(value) (0x7u & (value))
+#define DMAC_CHEVCTRL_EVIE (1u << 6)
+#define DMAC_CHEVCTRL_EVOE (1u << 7)
+#define DMAC_CHINTENCLR_MASK 0x07u
+#define DMAC_CHINTENSET_TERR (1u << 0)
+#define DMAC_CHINTENSET_TCMPL (1u << 1)
+#define DMAC_CHINTENSET_SUSP (1u << 2)
+#define DMAC_CHINTFLAG_TERR (1u << 0)
+#define DMAC_CHINTFLAG_TCMPL (1u << 1)
+#define DMAC_CHINTFLAG_SUSP (1u << 2)
+#define DMAC_CHINTFLAG_MASK 0x07u
+
+typedef struct {
+    volatile union {
+        struct {
+            uint16_t SWRST:1;
+            uint16_t DMAENABLE:1;
+            uint16_t :6;
+            uint16_t LVLEN0:1;
+            uint16_t LVLEN1:1;
+            uint16_t LVLEN2:1;
+            uint16_t LVLEN3:1;
+            uint16_t :4;
+        } bit;
+        uint16_t reg;
+    } CTRL;
+    volatile union {
+        uint16_t reg;
+    } CRCCTRL;
+    volatile union {
+        uint32_t reg;
+    } CRCDATAIN;
+    volatile union {
+        uint32_t reg;
+    } CRCCHKSUM;
+    volatile union {
+        uint8_t reg;
+    } CRCSTATUS;
+    volatile union {
+        uint8_t reg;
+    } DBGCTRL;
+    volatile union {
+        uint32_t reg;
+    } SWTRIGCTRL;
+    volatile union {
+        uint32_t reg;
+    } PRICTRL0;
+    volatile union {
+        uint16_t reg;
+    } INTPEND;
+    volatile union {
+        uint32_t reg;
+    } INTSTATUS;
+    volatile union {
+        uint32_t reg;
+    } BUSYCH;
+    volatile union {
+        uint32_t reg;
+    } PENDCH;
+    volatile union {
+        struct {
+            uint32_t LVLEX0:1;
+            uint32_t LVLEX1:1;
+            uint32_t LVLEX2:1;
+            uint32_t LVLEX3:1;
+            uint32_t :4;
+            uint32_t ID:5;
+            uint32_t :2;
+            uint32_t ABUSY:1;
+            uint32_t BTCNT:16;
+        } bit;
+        uint32_t reg;
+    } ACTIVE;
+    volatile union {
+        uint32_t reg;
+    } BASEADDR;
+    volatile union {
+        uint32_t reg;
+    } WRBADDR;
+    DmacChannel Channel[32];
+} Dmac;
+
+#define DMAC_CTRL_SWRST (1u << 0)
+#define DMAC_CTRL_DMAENABLE (1u << 1)
+#define DMAC_CTRL_LVLEN0 (1u << 8)
+#define DMAC_CTRL_LVLEN1 (1u << 9)
+#define DMAC_CTRL_LVLEN2 (1u << 10)
+#define DMAC_CTRL_LVLEN3 (1u << 11)
+#define DMAC_CRCCTRL_CRCBEATSIZE(value) (0x3u & (value))
+#define DMAC_CRCCTRL_CRCPOLY_CRC16 (0x0u << 2)
+#define DMAC_CRCCTRL_CRCPOLY_CRC32 (0x1u << 2)
+#define DMAC_CRCCTRL_CRCSRC(value) ((0x3fu & (value)) << 8)
+#define DMAC_CRCSTATUS_CRCBUSY (1u << 0)
+#define DMAC_PRICTRL0_RRLVLEN0 (1u << 7)
+
+// SERCOM
+
+typedef struct {
+    volatile union {
+        struct {
+            uint32_t SWRST:1;
+            uint32_t ENABLE:1;
+            uint32_t :30;
+        } bit;
+        uint32_t reg;
+    } CTRLA;
+    volatile union {
+        uint32_t reg;
+    } CTRLB;
+    volatile union {
+        struct {
+            uint32_t :24;
+            uint32_t DATA32B:1;
+            uint32_t :7;
+        } bit;
+        uint32_t reg;
+    } CTRLC;
+    volatile union {
+        struct {
+            uint8_t DRE:1;
+            uint8_t TXC:1;
+            uint8_t RXC:1;
+            uint8_t SSL:1;
+            uint8_t :3;
+            uint8_t ERROR:1;
+        } bit;
+        uint8_t reg;
+    } INTFLAG;
+    volatile union {
+        struct {
+            uint16_t :2;
+            uint16_t BUFOVF:1;
+            uint16_t :13;
+        } bit;
+        uint16_t reg;
+    } STATUS;
+    volatile union {
+        struct {
+            uint32_t SWRST:1;
+            uint32_t ENABLE:1;
+            uint32_t CTRLB:1;
+            uint32_t :1;
+            uint32_t LENGTH:1;
+            uint32_t :27;
+        } bit;
+        uint32_t reg;
+    } SYNCBUSY;
+    volatile union {
+        uint16_t reg;
+    } LENGTH;
+    volatile union {
+        uint32_t reg;
+    } DATA;
+} SercomSpi;
+
+typedef union {
+    SercomSpi SPI;
+} Sercom;
+
+#define SERCOM_SPI_INTFLAG_DRE (1u << 0)
+#define SERCOM_SPI_INTFLAG_TXC (1u << 1)
+#define SERCOM_SPI_INTFLAG_RXC (1u << 2)
+#define SERCOM_SPI_INTFLAG_ERROR (1u << 7)
+
+// Everything else samd/dma.c touches
+
+typedef struct {
+    uint32_t reserved;
+} Qspi;
+
+typedef struct {
+    volatile union {
+        uint32_t reg;
+    } AHBMASK;
+} Mclk;
+
+#define MCLK_AHBMASK_DMAC (1u << 9)
+#define QSPI_AHB 0x04000000
+#define QSPI_DMAC_ID_RX 0x46
+#define QSPI_DMAC_ID_TX 0x47
+#define EVSYS_ID_USER_DMAC_CH_0 5
+
+// Instances
+
+extern Dmac dmac_model_dmac;
+extern Sercom dmac_model_sercoms[2];
+extern Qspi dmac_model_qspi;
+extern Mclk dmac_model_mclk;
+extern DWT_Type dmac_model_dwt;
+extern CoreDebug_Type dmac_model_core_debug;
+
+#define DMAC (&dmac_model_dmac)
+#define SERCOM0 (&dmac_model_sercoms[0])
+#define SERCOM1 (&dmac_model_sercoms[1])
+#define SERCOM_INST_NUM 2
+#define QSPI (&dmac_model_qspi)
+#define MCLK (&dmac_model_mclk)
+#define DWT (&dmac_model_dwt)
+#define CoreDebug (&dmac_model_core_debug)
+
+#endif  // MICROPY_INCLUDED_ATMEL_SAMD_HOST_SAM_H
@@ -0,0 +1,233 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Scott Shawcroft for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Runs the asynchronous paths of samd/dma.c against host/dmac_model.c. From the top of the tree:
+//   cc -std=gnu99 -Wall -no-pie -I. -Ihost -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast
+//       samd/dma.c host/dmac_model.c host/test_dma.c -o test_dma && ./test_dma
+
+#include <stdio.h>
+#include <string.h>
+
+#include "samd/dma.h"
+
+#include "host/dmac_model.h"
+
+static int failures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// Everything a descriptor points at has to be static.
+static dma_transfer_t transfer;
+static uint8_t buffer_out[600];
+static uint8_t buffer_in[600];
+static sercom_dma_session_t session;
+
+static int callback_count;
+static int32_t callback_result;
+
+static void record_result(dma_transfer_t* finished, int32_t result, void* data) {
+    CHECK(finished == &transfer);
+    CHECK(data == &callback_count);
+    callback_count++;
+    callback_result = result;
+}
+
+static void setup(void) {
+    dmac_model_reset();
+    init_shared_dma();
+    callback_count = 0;
+    callback_result = 0;
+    for (uint32_t i = 0; i < sizeof(buffer_out); i++) {
+        buffer_out[i] = i * 7;
+    }
+    memset(buffer_in, 0, sizeof(buffer_in));
+}
+
+// True when channel_number is back in the pool.
+static bool channel_released(uint8_t channel_number) {
+    uint8_t channel = dma_allocate_channel(1u << channel_number);
+    if (channel == NO_DMA_CHANNEL) {
+        return false;
+    }
+    dma_free_channel(channel);
+    return true;
+}
+
+static void test_write_completes_from_interrupt(void) {
+    setup();
+    CHECK(sercom_dma_write_async(&transfer, SERCOM0, buffer_out, sizeof(buffer_out),
+                                 record_result, &callback_count) == 0);
+    uint8_t channel = transfer.tx_channel;
+    CHECK(dma_channel_enabled(channel));
+    CHECK(callback_count == 0);
+    CHECK(!transfer.complete);
+
+    dmac_model_run(channel);
+    CHECK(callback_count == 1);
+    CHECK(callback_result == sizeof(buffer_out));
+    CHECK(transfer.complete);
+    CHECK(SERCOM0->SPI.DATA.reg == buffer_out[sizeof(buffer_out) - 1]);
+    CHECK(channel_released(channel));
+}
+
+static void test_read_waits_for_both_channels(void) {
+    setup();
+    CHECK(sercom_dma_transfer_async(&transfer, SERCOM1, buffer_out, buffer_in, 100,
+                                    record_result, &callback_count) == 0);
+    uint8_t rx_channel = transfer.rx_channel;
+    uint8_t tx_channel = transfer.tx_channel;
+
+    dmac_model_run(tx_channel);
+    CHECK(callback_count == 0);
+    dmac_model_run(rx_channel);
+    CHECK(callback_count == 1);
+    CHECK(callback_result == 100);
+    CHECK(channel_released(rx_channel));
+    CHECK(channel_released(tx_channel));
+}
+
+static void test_error_closes_transfer(void) {
+    setup();
+    CHECK(sercom_dma_transfer_async(&transfer, SERCOM0, buffer_out, buffer_in, 100,
+                                    record_result, &callback_count) == 0);
+    uint8_t rx_channel = transfer.rx_channel;
+    uint8_t tx_channel = transfer.tx_channel;
+
+    // RX never finishes once TX has stopped so the error has to end the transfer by itself.
+    dmac_model_error(tx_channel);
+    CHECK(callback_count == 1);
+    CHECK(callback_result == DMA_FAILURE_INCOMPLETE);
+    CHECK(!dma_channel_enabled(rx_channel));
+    CHECK(channel_released(rx_channel));
+    CHECK(channel_released(tx_channel));
+}
+
+static void test_memcpy_moves_data(void) {
+    setup();
+    CHECK(dma_memcpy_async(&transfer, buffer_in, buffer_out, sizeof(buffer_out),
+                           record_result, &callback_count) == 0);
+    CHECK(callback_count == 0);
+    CHECK(DMAC->SWTRIGCTRL.reg == 1u << transfer.tx_channel);
+    dmac_model_run(transfer.tx_channel);
+    CHECK(callback_count == 1);
+    CHECK(callback_result == sizeof(buffer_out));
+    CHECK(memcmp(buffer_in, buffer_out, sizeof(buffer_out)) == 0);
+}
+
+static void test_empty_transfer_never_starts(void) {
+    setup();
+    dma_iovec_t empty = {buffer_out, 0};
+    shared_dma_transfer_start_iovec_async(&transfer, SERCOM0, &empty, 1, &SERCOM0->SPI.DATA.reg,
+                                          NULL, NULL, 0, 0, record_result, &callback_count);
+    CHECK(transfer.failure == DMA_FAILURE_INVALID_LENGTH);
+    CHECK(callback_count == 0);
+    for (uint8_t i = 0; i < DMA_CHANNEL_COUNT; i++) {
+        CHECK(!dma_channel_enabled(i) || (DMA_AUDIO_CHANNEL_MASK & (1u << i)) != 0);
+    }
+}
+
+static void test_session_queue(void) {
+    setup();
+    CHECK(sercom_dma_session_open(&session, SERCOM0) == 0);
+    CHECK(sercom_dma_session_write(&session, buffer_out, 10) == 0);
+    CHECK(sercom_dma_session_write(&session, buffer_out + 10, 20) == 0);
+    CHECK(session.queued == 2);
+    // The interrupt starts the second write on the same channel.
+    dmac_model_run(session.channel);
+    CHECK(session.queued == 0);
+    CHECK(SERCOM0->SPI.DATA.reg == buffer_out[29]);
+    CHECK(sercom_dma_session_wait(&session) == 0);
+    sercom_dma_session_close(&session);
+
+    // Nothing written so there is no TXC to wait for.
+    setup();
+    CHECK(sercom_dma_session_open(&session, SERCOM0) == 0);
+    sercom_dma_session_close(&session);
+}
+
+static dma_ring_t ring;
+static uint8_t ring_blocks[4];
+static uint8_t ring_block_count;
+
+static void record_block(dma_ring_t* finished, uint8_t block, void* data) {
+    CHECK(finished == &ring);
+    ring_blocks[ring_block_count++ % sizeof(ring_blocks)] = block;
+}
+
+static void test_ring_interrupts(void) {
+    setup();
+    ring_block_count = 0;
+    uint8_t channel = dma_allocate_non_audio_channel();
+    CHECK(dma_ring_init(&ring, channel, 0, buffer_in, 100, 2, DMAC_BTCTRL_BEATSIZE_BYTE,
+                        &SERCOM0->SPI.DATA.reg, false, record_block, NULL) == 0);
+    dma_ring_start(&ring);
+    CHECK(DMAC->Channel[channel].CHINTENSET.reg == (DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR));
+    SERCOM0->SPI.DATA.reg = 0x5a;
+    dmac_model_run_block(channel);
+    dmac_model_run_block(channel);
+    dmac_model_run_block(channel);
+    CHECK(ring_block_count == 3);
+    CHECK(ring_blocks[0] == 0 && ring_blocks[1] == 1 && ring_blocks[2] == 0);
+    CHECK(ring.blocks_done == 3);
+    CHECK(buffer_in[0] == 0x5a && buffer_in[99] == 0x5a);
+    dma_ring_deinit(&ring);
+
+    // Nothing to call per block so only an error interrupts.
+    CHECK(dma_ring_init(&ring, channel, 0, buffer_in, 100, 2, DMAC_BTCTRL_BEATSIZE_BYTE,
+                        &SERCOM0->SPI.DATA.reg, false, NULL, NULL) == 0);
+    dma_ring_start(&ring);
+    CHECK(DMAC->Channel[channel].CHINTENSET.reg == DMAC_CHINTENSET_TERR);
+    dmac_model_run_block(channel);
+    CHECK(ring.blocks_done == 0);
+    dmac_model_error(channel);
+    CHECK(ring.failure == DMA_FAILURE_INCOMPLETE);
+    dma_ring_deinit(&ring);
+    dma_free_channel(channel);
+}
+
+int main(void) {
+    if (!dmac_model_address_ok(buffer_out) || !dmac_model_address_ok(&transfer)) {
+        printf("Static data isn't addressable by 32-bit descriptors. Link with -no-pie.\n");
+        return 1;
+    }
+    test_write_completes_from_interrupt();
+    test_read_waits_for_both_channels();
+    test_error_closes_transfer();
+    test_memcpy_moves_data();
+    test_empty_transfer_never_starts();
+    test_session_queue();
+    test_ring_interrupts();
+    if (failures == 0) {
+        printf("OK\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
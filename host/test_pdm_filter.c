@@ -0,0 +1,268 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Scott Shawcroft for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Checks samd/pdm_filter.c against a bit-serial CIC and times it. From the top of the tree:
+//   cc -std=gnu99 -Wall -O2 -I. host/test_pdm_filter.c -lm -o test_pdm_filter && ./test_pdm_filter
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Built in directly so the reference can share the comb, FIR and history handling.
+#include "samd/pdm_filter.c"
+
+static int failures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// 16384 samples for each microphone.
+#define WORD_COUNT (16384 * 4)
+
+static uint32_t words[WORD_COUNT];
+static int16_t expected_left[WORD_COUNT / 4];
+static int16_t expected_right[WORD_COUNT / 4];
+static int16_t left_pcm[WORD_COUNT / 4];
+static int16_t right_pcm[WORD_COUNT / 4];
+
+// One bit per step, which is what the nibble table has to match.
+static void reference_integrate(pdm_filter_t* filter, uint16_t bits) {
+    uint32_t i0 = filter->integrators[0];
+    uint32_t i1 = filter->integrators[1];
+    uint32_t i2 = filter->integrators[2];
+    uint32_t i3 = filter->integrators[3];
+    for (int8_t b = 15; b >= 0; b--) {
+        i0 += ((bits >> b) & 1) * 2 - 1;
+        i1 += i0;
+        i2 += i1;
+        i3 += i2;
+    }
+    filter->integrators[0] = i0;
+    filter->integrators[1] = i1;
+    filter->integrators[2] = i2;
+    filter->integrators[3] = i3;
+}
+
+static uint32_t reference_run(pdm_filter_t* filter, const uint32_t* in, uint32_t word_count, bool right,
+                              int16_t* pcm) {
+    uint8_t shift = right ? 0 : 16;
+    uint32_t produced = 0;
+    for (uint32_t w = 0; w < word_count; w++) {
+        reference_integrate(filter, in[w] >> shift);
+        filter->cic_phase++;
+        if ((filter->cic_phase & 1) != 0) {
+            continue;
+        }
+        int16_t sample = cic_comb(filter);
+        uint8_t index = filter->history_index;
+        filter->history[index] = sample;
+        filter->history[index + PDM_FILTER_FIR_TAPS] = sample;
+        index++;
+        if (index == PDM_FILTER_FIR_TAPS) {
+            index = 0;
+        }
+        filter->history_index = index;
+        if ((filter->cic_phase & 3) != 0) {
+            continue;
+        }
+        pcm[produced++] = saturate16(fir(filter->history + index) >> 15);
+        filter->cic_phase = 0;
+    }
+    return produced;
+}
+
+static void fill_random(void) {
+    uint32_t state = 0x12345678;
+    for (uint32_t i = 0; i < WORD_COUNT; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        words[i] = state;
+    }
+}
+
+// A second order sigma-delta modulator with a 1 kHz sine at half scale on the left microphone and
+// silence on the right. 16 kHz PCM is a 1.024 MHz bitstream.
+static void fill_sine(void) {
+    double s1 = 0;
+    double s2 = 0;
+    double feedback = 0;
+    double quiet1 = 0;
+    double quiet2 = 0;
+    double quiet_feedback = 0;
+    for (uint32_t i = 0; i < WORD_COUNT; i++) {
+        uint32_t word = 0;
+        for (int8_t b = 15; b >= 0; b--) {
+            uint32_t n = i * 16 + (15 - b);
+            double x = 0.5 * sin(2 * M_PI * 1000.0 * n / (16000.0 * PDM_FILTER_OVERSAMPLING));
+            s1 += x - feedback;
+            s2 += s1 - feedback;
+            feedback = s2 >= 0 ? 1 : -1;
+            quiet1 -= quiet_feedback;
+            quiet2 += quiet1 - quiet_feedback;
+            quiet_feedback = quiet2 >= 0 ? 1 : -1;
+            word |= (uint32_t) (feedback > 0) << (b + 16);
+            word |= (uint32_t) (quiet_feedback > 0) << b;
+        }
+        words[i] = word;
+    }
+}
+
+static void reference_both(void) {
+    pdm_filter_t filter;
+    pdm_filter_init(&filter);
+    reference_run(&filter, words, WORD_COUNT, false, expected_left);
+    pdm_filter_init(&filter);
+    reference_run(&filter, words, WORD_COUNT, true, expected_right);
+}
+
+static void test_matches_reference(void) {
+    fill_random();
+    reference_both();
+    pdm_filter_t filter;
+    pdm_filter_init(&filter);
+    CHECK(pdm_filter_run(&filter, words, WORD_COUNT, false, left_pcm) == WORD_COUNT / 4);
+    CHECK(memcmp(left_pcm, expected_left, sizeof(left_pcm)) == 0);
+    pdm_filter_init(&filter);
+    CHECK(pdm_filter_run(&filter, words, WORD_COUNT, true, right_pcm) == WORD_COUNT / 4);
+    CHECK(memcmp(right_pcm, expected_right, sizeof(right_pcm)) == 0);
+}
+
+static void test_split_calls_match(void) {
+    fill_random();
+    reference_both();
+    pdm_filter_t filter;
+    pdm_filter_init(&filter);
+    // Odd lengths leave a partial sample to carry over.
+    uint32_t produced = 0;
+    uint32_t w = 0;
+    for (uint32_t length = 1; w < WORD_COUNT; length = length % 13 + 1) {
+        if (length > WORD_COUNT - w) {
+            length = WORD_COUNT - w;
+        }
+        produced += pdm_filter_run(&filter, words + w, length, false, left_pcm + produced);
+        w += length;
+    }
+    CHECK(produced == WORD_COUNT / 4);
+    CHECK(memcmp(left_pcm, expected_left, sizeof(left_pcm)) == 0);
+}
+
+static void test_stereo_matches(void) {
+    fill_random();
+    reference_both();
+    pdm_filter_t left;
+    pdm_filter_t right;
+    pdm_filter_init(&left);
+    pdm_filter_init(&right);
+    uint32_t produced = pdm_filter_run_stereo(&left, &right, words, 7, left_pcm, right_pcm);
+    produced += pdm_filter_run_stereo(&left, &right, words + 7, WORD_COUNT - 7, left_pcm + produced,
+                                      right_pcm + produced);
+    CHECK(produced == WORD_COUNT / 4);
+    CHECK(memcmp(left_pcm, expected_left, sizeof(left_pcm)) == 0);
+    CHECK(memcmp(right_pcm, expected_right, sizeof(right_pcm)) == 0);
+}
+
+static void test_sine_level(void) {
+    fill_sine();
+    pdm_filter_t left;
+    pdm_filter_t right;
+    pdm_filter_init(&left);
+    pdm_filter_init(&right);
+    pdm_filter_run_stereo(&left, &right, words, WORD_COUNT, left_pcm, right_pcm);
+    // Skip the filters settling.
+    int16_t left_peak = 0;
+    int16_t right_peak = 0;
+    for (uint32_t i = 256; i < WORD_COUNT / 4; i++) {
+        if (abs(left_pcm[i]) > left_peak) {
+            left_peak = abs(left_pcm[i]);
+        }
+        if (abs(right_pcm[i]) > right_peak) {
+            right_peak = abs(right_pcm[i]);
+        }
+    }
+    printf("1 kHz sine at half scale peaks at %d, silence at %d\n", left_peak, right_peak);
+    CHECK(left_peak > 15800 && left_peak < 16600);
+    CHECK(right_peak < 200);
+}
+
+static double elapsed_ns(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+// Only prints. Host numbers say nothing firm about the M4 but show whether a change helps.
+static void benchmark(void) {
+    fill_random();
+    const int passes = 20;
+    pdm_filter_t left;
+    pdm_filter_t right;
+    struct timespec start;
+
+    pdm_filter_init(&left);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < passes; i++) {
+        reference_run(&left, words, WORD_COUNT, false, left_pcm);
+    }
+    double reference = elapsed_ns(&start) / (passes * (WORD_COUNT / 4));
+
+    pdm_filter_init(&left);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < passes; i++) {
+        pdm_filter_run(&left, words, WORD_COUNT, false, left_pcm);
+    }
+    double mono = elapsed_ns(&start) / (passes * (WORD_COUNT / 4));
+
+    pdm_filter_init(&left);
+    pdm_filter_init(&right);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < passes; i++) {
+        pdm_filter_run_stereo(&left, &right, words, WORD_COUNT, left_pcm, right_pcm);
+    }
+    double stereo = elapsed_ns(&start) / (passes * (WORD_COUNT / 4));
+
+    printf("%.1f ns/sample bit-serial, %.1f ns/sample nibble table, %.1f ns per stereo pair\n",
+           reference, mono, stereo);
+}
+
+int main(void) {
+    test_matches_reference();
+    test_split_calls_match();
+    test_stereo_matches();
+    test_sine_level();
+    benchmark();
+    if (failures == 0) {
+        printf("OK\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
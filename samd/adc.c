@@ -0,0 +1,61 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Scott Shawcroft for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "samd/adc.h"
+
+// AVGCTRL values for 13 to 16 bits. Each extra bit takes four times as many conversions. The ADC
+// shifts off everything above 16 bits before ADJRES so the adjustment isn't simply half of
+// SAMPLENUM.
+static const uint8_t oversampling_samplenum[] = {2, 4, 6, 8};
+static const uint8_t oversampling_adjres[] = {1, 2, 1, 0};
+
+uint16_t adc_oversampling_conversions(uint8_t bits) {
+    if (bits <= 12) {
+        return 1;
+    }
+    if (bits > 16) {
+        bits = 16;
+    }
+    return 1 << (2 * (bits - 12));
+}
+
+uint16_t adc_set_averaging(Adc* instance, uint8_t averaging, uint8_t resolution) {
+    if (resolution > 12) {
+        uint8_t i = (resolution > 16 ? 16 : resolution) - 13;
+        instance->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM(oversampling_samplenum[i]) |
+                                ADC_AVGCTRL_ADJRES(oversampling_adjres[i]);
+        return ADC_CTRLB_RESSEL_16BIT;
+    }
+    if (averaging > 0) {
+        // Averages accumulate into a 16-bit result and ADJRES divides them back down to 12 bits.
+        // Above 16 samples the ADC already shifts the extra bits off.
+        uint8_t adjres = averaging < 4 ? averaging : 4;
+        instance->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM(averaging) | ADC_AVGCTRL_ADJRES(adjres);
+        return ADC_CTRLB_RESSEL_16BIT;
+    }
+    instance->AVGCTRL.reg = 0;
+    return ADC_CTRLB_RESSEL_12BIT;
+}
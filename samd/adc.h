@@ -27,9 +27,133 @@
 #ifndef MICROPY_INCLUDED_ATMEL_SAMD_PERIPHERALS_ADC_H
 #define MICROPY_INCLUDED_ATMEL_SAMD_PERIPHERALS_ADC_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "include/sam.h"
 #include "hal/include/hal_adc_sync.h"
 
+#include "samd/dma.h"
+#include "shared-bindings/microcontroller/Pin.h"
+
 void samd_peripherals_adc_setup(struct adc_sync_descriptor *adc, Adc *instance);
 
+// An ADC that is set up and calibrated once and then stays enabled. Switching inputs only
+// rewrites INPUTCTRL.MUXPOS so scanning many pins is fast. resolution is a CTRLB.RESSEL value.
+typedef struct {
+    Adc* instance;
+    struct adc_sync_descriptor adc;
+    uint8_t resolution;
+} adc_context_t;
+
+void adc_context_init(adc_context_t* context, Adc* instance, uint8_t reference, uint8_t resolution,
+                      uint8_t prescaler, uint8_t sample_length);
+void adc_context_select(adc_context_t* context, uint8_t input);
+// Do one conversion of the selected input.
+uint16_t adc_context_read(adc_context_t* context);
+// Oversample each read to 13 to 16 bits. 12 or less goes back to the resolution from init with
+// single conversions.
+void adc_context_set_oversampling(adc_context_t* context, uint8_t bits);
+void adc_context_deinit(adc_context_t* context);
+
+// Conversions the ADC accumulates for each result with bits of resolution: 1 up to 12 bits and
+// then 4, 16, 64 and 256 for 13 to 16 bits.
+uint16_t adc_oversampling_conversions(uint8_t bits);
+
+// Set AVGCTRL for averaging or for resolution bits of oversampling and return the CTRLB.RESSEL
+// value to go with it. Both series lay these out the same way.
+uint16_t adc_set_averaging(Adc* instance, uint8_t averaging, uint8_t resolution);
+
+// Start conversions with SWTRIG once and let the ADC run on its own.
+#define ADC_STREAM_FREE_RUNNING 0xff
+
+// Register field values for a streaming capture. The pin must already be set to its analog function.
+typedef struct {
+    // INPUTCTRL.MUXPOS, usually adc_input[] of an mcu_pin_obj_t.
+    uint8_t input;
+    // REFCTRL.REFSEL.
+    uint8_t reference;
+    // PRESCALER, which is in CTRLB on the SAMD21 and CTRLA on the SAMD51.
+    uint8_t prescaler;
+    // SAMPCTRL.SAMPLEN.
+    uint8_t sample_length;
+    // AVGCTRL.SAMPLENUM. Each result is the average of 1 << averaging conversions. 0 turns it off.
+    uint8_t averaging;
+    // Bits per result. 13 to 16 oversample and decimate in hardware instead of averaging, which
+    // divides the result rate by adc_oversampling_conversions(). 0 means 12.
+    uint8_t resolution;
+    // WINMODE. 0 turns the window monitor off.
+    uint8_t window_mode;
+    uint16_t window_lower;
+    uint16_t window_upper;
+    // Event channel that starts each conversion, such as a TC overflow, or ADC_STREAM_FREE_RUNNING.
+    uint8_t event_channel;
+} adc_stream_config_t;
+
+// An ADC that DMAs every 12-bit result into a ring of uint16_t samples.
+typedef struct {
+    Adc* instance;
+    struct adc_sync_descriptor adc;
+    dma_ring_t ring;
+    uint8_t dma_channel;
+    uint8_t event_channel;
+} adc_stream_t;
+
+// Returns 0 or a DMA_FAILURE_* value. buffer holds sample_count samples split into block_count
+// blocks and callback is called from the DMAC interrupt as each block fills.
+int32_t adc_stream_init(adc_stream_t* stream, Adc* instance, const adc_stream_config_t* config,
+                        uint16_t* buffer, uint32_t sample_count, uint8_t block_count,
+                        dma_ring_callback_t callback, void* callback_data);
+void adc_stream_start(adc_stream_t* stream);
+void adc_stream_stop(adc_stream_t* stream);
+void adc_stream_deinit(adc_stream_t* stream);
+// True if a result matched the window since the last call.
+bool adc_stream_window_hit(adc_stream_t* stream);
+// True if results came faster than the DMA could take them since the last call.
+bool adc_stream_overrun(adc_stream_t* stream);
+
+#ifdef SAM_D5X_E5X
+// ADC0 and ADC1 converting at the same moment from ADC0's trigger. buffer holds pair_count pairs
+// of samples with ADC0's first. config1's prescaler and event_channel are ignored. callback is
+// called as each block of pairs fills.
+typedef struct {
+    adc_stream_t master;
+    adc_stream_t slave;
+} adc_dual_stream_t;
+
+int32_t adc_dual_stream_init(adc_dual_stream_t* dual, const adc_stream_config_t* config0,
+                             const adc_stream_config_t* config1, uint16_t* buffer, uint32_t pair_count,
+                             uint8_t block_count, dma_ring_callback_t callback, void* callback_data);
+void adc_dual_stream_start(adc_dual_stream_t* dual);
+void adc_dual_stream_stop(adc_dual_stream_t* dual);
+void adc_dual_stream_deinit(adc_dual_stream_t* dual);
+
+// Returned when a pin has no input on the ADC being set up.
+#define ADC_FAILURE_INVALID_INPUT (-16)
+
+#ifndef ADC_SCAN_MAX_INPUTS
+#define ADC_SCAN_MAX_INPUTS 16
+#endif
+
+// Convert a list of pins round robin using the ADC's DMA sequencing. A second channel writes each
+// pin's INPUTCTRL into DSEQDATA before its conversion so the scan needs no CPU at all. buffer
+// holds round_count rounds of one sample per pin, in pin order, and each of the block_count
+// blocks must hold whole rounds. config's input is ignored.
+typedef struct {
+    adc_stream_t stream;
+    dma_ring_t sequence_ring;
+    uint8_t sequence_channel;
+    uint8_t input_count;
+    uint32_t sequence[ADC_SCAN_MAX_INPUTS];
+} adc_scan_t;
+
+int32_t adc_scan_init(adc_scan_t* scan, Adc* instance, const adc_stream_config_t* config,
+                      const mcu_pin_obj_t* const* pins, uint8_t pin_count,
+                      uint16_t* buffer, uint32_t round_count, uint8_t block_count,
+                      dma_ring_callback_t callback, void* callback_data);
+void adc_scan_start(adc_scan_t* scan);
+void adc_scan_stop(adc_scan_t* scan);
+void adc_scan_deinit(adc_scan_t* scan);
+#endif
+
 #endif  // MICROPY_INCLUDED_ATMEL_SAMD_PERIPHERALS_ADC_H
@@ -56,6 +56,29 @@ void disconnect_gclk_from_peripheral(uint8_t gclk, uint8_t peripheral);
 void enable_clock_generator(uint8_t gclk, uint32_t source, uint16_t divisor);
 void disable_clock_generator(uint8_t gclk);
 
+// Limits for a DPLL run from a GCLK. The output is the reference times a whole multiplier.
+#ifdef SAM_D5X_E5X
+#define CLOCK_DPLL_MIN_FREQUENCY 96000000
+#define CLOCK_DPLL_MAX_FREQUENCY 200000000
+#define CLOCK_DPLL_MIN_REFERENCE 32000
+#define CLOCK_DPLL_MAX_REFERENCE 3200000
+#define CLOCK_DPLL_MAX_MULTIPLIER 8192
+#endif
+#ifdef SAMD21
+#define CLOCK_DPLL_MIN_FREQUENCY 48000000
+#define CLOCK_DPLL_MAX_FREQUENCY 96000000
+#define CLOCK_DPLL_MIN_REFERENCE 32000
+#define CLOCK_DPLL_MAX_REFERENCE 2000000
+#define CLOCK_DPLL_MAX_MULTIPLIER 4096
+#endif
+
+// Returns the GCLK source value of a DPLL nothing is using or 0xff. DPLL0 on the SAMD51 runs the
+// CPU so it is never free.
+uint8_t find_free_dpll(void);
+// Lock the DPLL to reference_gclk times multiplier. Blocks until it is locked.
+void enable_dpll(uint8_t source, uint8_t reference_gclk, uint16_t multiplier);
+void disable_dpll(uint8_t source);
+
 /**
  * @brief Called during port_init to setup system clocks.
  *
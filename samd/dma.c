@@ -33,6 +33,8 @@
 
 #include "hal/utils/include/utils.h"
 
+#include "samd/events.h"
+
 #include "shared-bindings/microcontroller/__init__.h"
 
 COMPILER_ALIGNED(16) static DmacDescriptor dma_descriptors[DMA_CHANNEL_COUNT];
@@ -40,6 +42,11 @@ COMPILER_ALIGNED(16) static DmacDescriptor dma_descriptors[DMA_CHANNEL_COUNT];
 // Don't use these directly. They are used by the DMA engine itself.
 COMPILER_ALIGNED(16) static DmacDescriptor write_back_descriptors[DMA_CHANNEL_COUNT];
 
+// Descriptors for the second block onwards of a chain. The first block of a channel is always in
+// dma_descriptors.
+COMPILER_ALIGNED(16) static DmacDescriptor linked_descriptors[DMA_LINKED_DESCRIPTOR_COUNT];
+static bool linked_descriptor_allocated[DMA_LINKED_DESCRIPTOR_COUNT];
+
 #ifdef SAMD21
 #define FIRST_SERCOM_RX_TRIGSRC 0x01
 #define FIRST_SERCOM_TX_TRIGSRC 0x02
@@ -49,27 +56,169 @@ COMPILER_ALIGNED(16) static DmacDescriptor write_back_descriptors[DMA_CHANNEL_CO
 #define FIRST_SERCOM_TX_TRIGSRC 0x05
 #endif
 
-static bool dma_allocated[DMA_CHANNEL_COUNT];
+// One bit per allocated channel. It is changed from interrupts too so updates must be atomic.
+static volatile uint32_t dma_allocated;
 
-uint8_t dma_allocate_audio_channel(void) {
-    for (uint8_t channel = 0; channel < AUDIO_DMA_CHANNEL_COUNT; channel++) {
-        if (!dma_allocated[channel]) {
-            dma_allocated[channel] = true;
-            return channel;
+// Interrupt routing for channels that asked for it. channel_callback_mask has a bit set for every
+// channel with a callback so the interrupt handler can skip the rest.
+static dma_channel_callback_t channel_callbacks[DMA_CHANNEL_COUNT];
+static void* channel_callback_data[DMA_CHANNEL_COUNT];
+static uint8_t channel_interrupt_flags[DMA_CHANNEL_COUNT];
+static volatile uint32_t channel_callback_mask;
+
+static dma_watchdog_stats_t watchdog_stats;
+
+#if DMA_STATISTICS
+static dma_stats_t dma_stats;
+static dma_trace_event_t dma_trace[DMA_TRACE_LENGTH];
+// Sequence number of the next trace event.
+static volatile uint32_t dma_trace_next;
+
+static uint32_t dma_stats_time(void) {
+    #ifdef SAM_D5X_E5X
+    return DWT->CYCCNT;
+    #endif
+    #ifdef SAMD21
+    return 0;
+    #endif
+}
+
+// Claim a trace slot without locking so this works from interrupts too.
+static void dma_trace_add(dma_transfer_t* transfer, uint32_t timestamp, int32_t result) {
+    uint32_t sequence;
+    #ifdef SAM_D5X_E5X
+    do {
+        sequence = __LDREXW(&dma_trace_next);
+    } while (__STREXW(sequence + 1, &dma_trace_next) != 0);
+    #endif
+    #ifdef SAMD21
+    mp_hal_disable_all_interrupts();
+    sequence = dma_trace_next++;
+    mp_hal_enable_all_interrupts();
+    #endif
+    dma_trace_event_t* event = &dma_trace[sequence % DMA_TRACE_LENGTH];
+    // Invalidate the slot while it's being written.
+    event->sequence = sequence - 1;
+    event->timestamp = timestamp;
+    event->peripheral = transfer->peripheral;
+    event->length = transfer->length;
+    event->rx_channel = transfer->rx_active ? transfer->rx_channel : NO_DMA_CHANNEL;
+    event->tx_channel = transfer->tx_active ? transfer->tx_channel : NO_DMA_CHANNEL;
+    event->result = result;
+    event->sequence = sequence;
+}
+
+static void dma_stats_count_channel(uint8_t channel, uint32_t length, bool failed) {
+    dma_channel_stats_t* stats = &dma_stats.channels[channel];
+    stats->transfers++;
+    if (failed) {
+        stats->failures++;
+    } else {
+        stats->bytes += length;
+    }
+}
+
+static void dma_stats_transfer_done(dma_transfer_t* transfer, int32_t result) {
+    uint32_t now = dma_stats_time();
+    bool failed = result < 0;
+    if (failed && -result <= DMA_FAILURE_COUNT) {
+        dma_stats.failures[-result - 1]++;
+    }
+    if (transfer->rx_active) {
+        dma_stats_count_channel(transfer->rx_channel, transfer->length, failed);
+    }
+    if (transfer->tx_active) {
+        dma_stats_count_channel(transfer->tx_channel, transfer->length, failed);
+    }
+    #ifdef SAM_D5X_E5X
+    uint32_t cycles = now - transfer->start_time;
+    uint8_t bucket = cycles == 0 ? 0 : 32 - __builtin_clz(cycles);
+    if (bucket >= DMA_LATENCY_BUCKET_COUNT) {
+        bucket = DMA_LATENCY_BUCKET_COUNT - 1;
+    }
+    dma_stats.latency[bucket]++;
+    #endif
+    dma_trace_add(transfer, now, result);
+}
+
+const dma_stats_t* dma_get_stats(void) {
+    return &dma_stats;
+}
+
+void dma_reset_stats(void) {
+    memset(&dma_stats, 0, sizeof(dma_stats));
+}
+
+size_t dma_read_trace(uint32_t* next_sequence, dma_trace_event_t* events, size_t max_events) {
+    uint32_t newest = dma_trace_next;
+    // Skip anything that has already been overwritten.
+    if (newest - *next_sequence > DMA_TRACE_LENGTH) {
+        *next_sequence = newest - DMA_TRACE_LENGTH;
+    }
+    size_t count = 0;
+    while (count < max_events && *next_sequence != newest) {
+        dma_trace_event_t* event = &dma_trace[*next_sequence % DMA_TRACE_LENGTH];
+        events[count] = *event;
+        // Only keep it if it wasn't being rewritten while we copied it.
+        if (events[count].sequence == *next_sequence && event->sequence == *next_sequence) {
+            count++;
         }
+        (*next_sequence)++;
     }
-    return NO_DMA_CHANNEL;
+    return count;
 }
+#endif
 
-uint8_t dma_allocate_non_audio_channel(void) {
-    // Start allocating above audio channels.
-    for (uint8_t channel = AUDIO_DMA_CHANNEL_COUNT; channel < DMA_CHANNEL_COUNT; channel++) {
-        if (!dma_allocated[channel]) {
-            dma_allocated[channel] = true;
-            return channel;
+// Allocate the lowest free channel in pool_mask. SAMD51 uses exclusive access so it never masks
+// interrupts. The Cortex-M0+ in the SAMD21 doesn't have it so it briefly disables interrupts.
+uint8_t dma_allocate_channel(uint32_t pool_mask) {
+    uint8_t channel;
+    #ifdef SAM_D5X_E5X
+    uint32_t allocated;
+    do {
+        allocated = __LDREXW(&dma_allocated);
+        uint32_t available = pool_mask & ~allocated;
+        if (available == 0) {
+            __CLREX();
+            return NO_DMA_CHANNEL;
         }
+        channel = __builtin_ctz(available);
+    } while (__STREXW(allocated | (1u << channel), &dma_allocated) != 0);
+    #endif
+    #ifdef SAMD21
+    mp_hal_disable_all_interrupts();
+    uint32_t available = pool_mask & ~dma_allocated;
+    if (available == 0) {
+        mp_hal_enable_all_interrupts();
+        return NO_DMA_CHANNEL;
     }
-    return NO_DMA_CHANNEL;
+    channel = __builtin_ctz(available);
+    dma_allocated |= 1u << channel;
+    mp_hal_enable_all_interrupts();
+    #endif
+    return channel;
+}
+
+static void dma_release_channel(uint8_t channel) {
+    #ifdef SAM_D5X_E5X
+    uint32_t allocated;
+    do {
+        allocated = __LDREXW(&dma_allocated);
+    } while (__STREXW(allocated & ~(1u << channel), &dma_allocated) != 0);
+    #endif
+    #ifdef SAMD21
+    mp_hal_disable_all_interrupts();
+    dma_allocated &= ~(1u << channel);
+    mp_hal_enable_all_interrupts();
+    #endif
+}
+
+uint8_t dma_allocate_audio_channel(void) {
+    return dma_allocate_channel(DMA_AUDIO_CHANNEL_MASK);
+}
+
+uint8_t dma_allocate_non_audio_channel(void) {
+    return dma_allocate_channel(DMA_NON_AUDIO_CHANNEL_MASK);
 }
 
 void dma_free_channel(uint8_t channel) {
@@ -78,7 +227,149 @@ void dma_free_channel(uint8_t channel) {
     }
     // Might or might not be already allocated.
     dma_disable_channel(channel);
-    dma_allocated[channel] = false;
+    dma_set_channel_callback(channel, 0, NULL, NULL);
+    dma_free_descriptor_chain(channel);
+    if ((DMA_AUDIO_CHANNEL_MASK & (1u << channel)) != 0) {
+        dma_set_channel_priority(channel, DMA_AUDIO_PRIORITY_LEVEL);
+    } else {
+        dma_set_channel_priority(channel, DMA_DEFAULT_PRIORITY_LEVEL);
+    }
+    dma_release_channel(channel);
+}
+
+void dma_set_channel_callback(uint8_t channel_number, uint8_t interrupt_flags, dma_channel_callback_t callback, void* data) {
+    dma_disable_channel_interrupts(channel_number);
+    mp_hal_disable_all_interrupts();
+    channel_callback_mask &= ~(1u << channel_number);
+    channel_callbacks[channel_number] = callback;
+    channel_callback_data[channel_number] = data;
+    channel_interrupt_flags[channel_number] = interrupt_flags;
+    if (callback != NULL) {
+        channel_callback_mask |= 1u << channel_number;
+    }
+    mp_hal_enable_all_interrupts();
+    // Flags that are already set will fire right away. That's what we want when a short
+    // transfer finishes before its callback is set.
+    if (callback != NULL) {
+        dma_enable_channel_interrupts(channel_number, interrupt_flags);
+    }
+}
+
+void dma_interrupt_handler(void) {
+    uint32_t pending = DMAC->INTSTATUS.reg & channel_callback_mask;
+    while (pending != 0) {
+        uint8_t channel = __builtin_ctz(pending);
+        pending &= pending - 1;
+        // An earlier callback may have freed this channel.
+        dma_channel_callback_t callback = channel_callbacks[channel];
+        if ((channel_callback_mask & (1u << channel)) == 0 || callback == NULL) {
+            continue;
+        }
+        uint8_t flags = dma_transfer_status(channel) & channel_interrupt_flags[channel];
+        if (flags == 0) {
+            continue;
+        }
+        dma_clear_channel_interrupts(channel, flags);
+        callback(channel, flags, channel_callback_data[channel]);
+    }
+}
+
+DmacDescriptor* dma_allocate_descriptor(void) {
+    DmacDescriptor* descriptor = NULL;
+    mp_hal_disable_all_interrupts();
+    for (uint16_t i = 0; i < DMA_LINKED_DESCRIPTOR_COUNT; i++) {
+        if (!linked_descriptor_allocated[i]) {
+            linked_descriptor_allocated[i] = true;
+            descriptor = &linked_descriptors[i];
+            break;
+        }
+    }
+    mp_hal_enable_all_interrupts();
+    return descriptor;
+}
+
+// Returns true if the descriptor came from dma_allocate_descriptor() and is still allocated.
+static bool linked_descriptor_in_use(uint32_t address) {
+    uint32_t first = (uint32_t) linked_descriptors;
+    if (address < first || address >= first + sizeof(linked_descriptors)) {
+        return false;
+    }
+    return linked_descriptor_allocated[(address - first) / sizeof(DmacDescriptor)];
+}
+
+void dma_free_descriptor(DmacDescriptor* descriptor) {
+    if (!linked_descriptor_in_use((uint32_t) descriptor)) {
+        return;
+    }
+    descriptor->BTCTRL.reg = 0;
+    descriptor->DESCADDR.reg = 0;
+    linked_descriptor_allocated[descriptor - linked_descriptors] = false;
+}
+
+void dma_free_descriptor_chain(uint8_t channel_number) {
+    DmacDescriptor* first = &dma_descriptors[channel_number];
+    uint32_t next = first->DESCADDR.reg;
+    first->DESCADDR.reg = 0;
+    // Stops at the end of the chain, when a loop comes back around or at a descriptor we don't own.
+    while (linked_descriptor_in_use(next)) {
+        DmacDescriptor* descriptor = (DmacDescriptor*) next;
+        next = descriptor->DESCADDR.reg;
+        dma_free_descriptor(descriptor);
+    }
+}
+
+bool dma_chain_append(uint8_t channel_number, DmacDescriptor** tail, uint16_t btctrl, uint32_t src, uint32_t dst, uint32_t beats) {
+    uint8_t beat_bytes = 1 << ((btctrl & DMAC_BTCTRL_BEATSIZE_Msk) >> DMAC_BTCTRL_BEATSIZE_Pos);
+    // STEPSIZE spreads out the beats on the side that STEPSEL picks.
+    uint8_t step_shift = (btctrl & DMAC_BTCTRL_STEPSIZE_Msk) >> DMAC_BTCTRL_STEPSIZE_Pos;
+    uint8_t src_step_shift = (btctrl & DMAC_BTCTRL_STEPSEL) != 0 ? step_shift : 0;
+    uint8_t dst_step_shift = (btctrl & DMAC_BTCTRL_STEPSEL) != 0 ? 0 : step_shift;
+    if (*tail == NULL) {
+        // Drop whatever the last job left here so an empty chain is never VALID.
+        dma_descriptors[channel_number].BTCTRL.reg = 0;
+        dma_descriptors[channel_number].DESCADDR.reg = 0;
+    }
+    while (beats > 0) {
+        uint16_t block_beats = beats > 0xffff ? 0xffff : beats;
+        uint32_t block_bytes = block_beats * beat_bytes;
+        DmacDescriptor* descriptor;
+        if (*tail == NULL) {
+            descriptor = &dma_descriptors[channel_number];
+        } else {
+            descriptor = dma_allocate_descriptor();
+            if (descriptor == NULL) {
+                return false;
+            }
+        }
+        descriptor->BTCTRL.reg = btctrl | DMAC_BTCTRL_VALID;
+        descriptor->BTCNT.reg = block_beats;
+        // Incrementing addresses point at the end of the block.
+        if ((btctrl & DMAC_BTCTRL_SRCINC) != 0) {
+            src += block_bytes << src_step_shift;
+        }
+        if ((btctrl & DMAC_BTCTRL_DSTINC) != 0) {
+            dst += block_bytes << dst_step_shift;
+        }
+        descriptor->SRCADDR.reg = src;
+        descriptor->DSTADDR.reg = dst;
+        descriptor->DESCADDR.reg = 0;
+        if (*tail != NULL) {
+            (*tail)->DESCADDR.reg = (uint32_t) descriptor;
+        }
+        *tail = descriptor;
+        beats -= block_beats;
+    }
+    return true;
+}
+
+bool dma_connect_event_input(uint8_t channel_number, uint8_t event_channel, uint8_t event_action, bool block_per_event) {
+    if ((DMA_EVENT_INPUT_CHANNEL_MASK & (1u << channel_number)) == 0) {
+        return false;
+    }
+    dma_configure_event_input(channel_number, event_action, block_per_event);
+    // The DMAC channel users are numbered in channel order.
+    connect_event_user_to_channel(EVSYS_ID_USER_DMAC_CH_0 + channel_number, event_channel);
+    return true;
 }
 
 void init_shared_dma(void) {
@@ -94,112 +385,377 @@ void init_shared_dma(void) {
 
     DMAC->CTRL.reg = DMAC_CTRL_SWRST;
 
+    #if DMA_STATISTICS && defined(SAM_D5X_E5X)
+    // Start the cycle counter used to time transfers.
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    #endif
+
     DMAC->BASEADDR.reg = (uint32_t) dma_descriptors;
     DMAC->WRBADDR.reg = (uint32_t) write_back_descriptors;
 
-    DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN0;
+    DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE |
+                     DMAC_CTRL_LVLEN0 | DMAC_CTRL_LVLEN1 | DMAC_CTRL_LVLEN2 | DMAC_CTRL_LVLEN3;
 
     // Configure audio channels in advance.
     // Non-audio channels will be configured on demand.
-    for (uint8_t i = 0; i < AUDIO_DMA_CHANNEL_COUNT; i++) {
-        dma_configure(i, 0, true);
+    for (uint8_t i = 0; i < DMA_CHANNEL_COUNT; i++) {
+        if ((DMA_AUDIO_CHANNEL_MASK & (1u << i)) != 0) {
+            dma_set_channel_priority(i, DMA_AUDIO_PRIORITY_LEVEL);
+            dma_configure(i, 0, true);
+        } else {
+            dma_set_channel_priority(i, DMA_DEFAULT_PRIORITY_LEVEL);
+        }
+    }
+
+    // Channel interrupts stay off until someone sets a callback so the lines can be on all the time.
+    #ifdef SAMD21
+    NVIC_ClearPendingIRQ(DMAC_IRQn);
+    NVIC_EnableIRQ(DMAC_IRQn);
+    #endif
+    #ifdef SAM_D5X_E5X
+    for (IRQn_Type irq = DMAC_0_IRQn; irq <= DMAC_4_IRQn; irq++) {
+        NVIC_ClearPendingIRQ(irq);
+        NVIC_EnableIRQ(irq);
     }
+    #endif
 }
 
-// Do write and read simultaneously. If buffer_out is NULL, write the tx byte over and over.
-// If buffer_out is a real buffer, ignore tx.
-// DMAs buffer_out -> dest
-// DMAs src -> buffer_in
-void shared_dma_transfer_start(dma_transfer_t *transfer, void* peripheral, const uint8_t* buffer_out, volatile uint32_t* dest, volatile uint32_t* src, uint8_t* buffer_in, uint32_t length, uint8_t tx) {
-    transfer->progress = 0;
+static uint32_t dma_iovec_length(const dma_iovec_t* iov, size_t iov_count) {
+    uint32_t length = 0;
+    for (size_t i = 0; i < iov_count; i++) {
+        length += iov[i].length;
+    }
+    return length;
+}
+
+#ifdef SAM_D5X_E5X
+static bool dma_iovec_aligned(const dma_iovec_t* iov, size_t iov_count, bool check_length) {
+    for (size_t i = 0; i < iov_count; i++) {
+        if ((((uint32_t) iov[i].buffer) & 0x3) != 0 ||
+            (check_length && (iov[i].length & 0x3) != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+static volatile bool crc_in_use = false;
+
+// Point the CRC engine at a channel. The CRC beat size must match the channel's beat size.
+static bool dma_crc_claim(uint8_t crc_type, uint8_t channel_number, uint16_t beat_size) {
+    mp_hal_disable_all_interrupts();
+    bool available = !crc_in_use;
+    crc_in_use = true;
+    mp_hal_enable_all_interrupts();
+    if (!available) {
+        return false;
+    }
+    uint32_t initial = 0xffffffff;
+    // CRCBEATSIZE uses the same values as BTCTRL.BEATSIZE.
+    uint16_t crcctrl = DMAC_CRCCTRL_CRCBEATSIZE((beat_size & DMAC_BTCTRL_BEATSIZE_Msk) >> DMAC_BTCTRL_BEATSIZE_Pos) |
+                       DMAC_CRCCTRL_CRCSRC(0x20 + channel_number);
+    if (crc_type == DMA_CRC_32) {
+        crcctrl |= DMAC_CRCCTRL_CRCPOLY_CRC32;
+    } else {
+        crcctrl |= DMAC_CRCCTRL_CRCPOLY_CRC16;
+        initial = 0xffff;
+    }
+    #ifdef SAMD21
+    // CRCCTRL can only be written while the CRC is off.
+    DMAC->CTRL.bit.CRCENABLE = false;
+    DMAC->CRCCHKSUM.reg = initial;
+    DMAC->CRCCTRL.reg = crcctrl;
+    DMAC->CTRL.bit.CRCENABLE = true;
+    #endif
+    #ifdef SAM_D5X_E5X
+    // The CRC is off while CRCSRC is 0.
+    DMAC->CRCCTRL.reg = 0;
+    DMAC->CRCCHKSUM.reg = initial;
+    DMAC->CRCCTRL.reg = crcctrl;
+    #endif
+    return true;
+}
+
+// The hardware bit-reverses and complements CRC-32 checksums on read so no fix up is needed.
+static uint32_t dma_crc_release(uint8_t crc_type) {
+    uint32_t checksum = DMAC->CRCCHKSUM.reg;
+    if (crc_type == DMA_CRC_16_CCITT) {
+        checksum &= 0xffff;
+    }
+    #ifdef SAMD21
+    DMAC->CTRL.bit.CRCENABLE = false;
+    #endif
+    #ifdef SAM_D5X_E5X
+    DMAC->CRCCTRL.reg = 0;
+    #endif
+    DMAC->CRCSTATUS.reg = DMAC_CRCSTATUS_CRCBUSY;
+    crc_in_use = false;
+    return checksum;
+}
 
-    // There's always a tx DMA channel, though it may be sending only the tx byte if buffer_out is NULL.
-    uint8_t tx_channel = dma_allocate_non_audio_channel();
-    if (tx_channel == NO_DMA_CHANNEL) {
-        transfer->failure = DMA_FAILURE_NO_CHANNEL_AVAILABLE;
+static void shared_dma_transfer_fail(dma_transfer_t* transfer, int8_t failure) {
+    if (transfer->crc_type != DMA_CRC_NONE) {
+        dma_crc_release(transfer->crc_type);
+        transfer->crc_type = DMA_CRC_NONE;
+    }
+    dma_free_channel(transfer->tx_channel);
+    dma_free_channel(transfer->rx_channel);
+    transfer->tx_channel = NO_DMA_CHANNEL;
+    transfer->rx_channel = NO_DMA_CHANNEL;
+    transfer->rx_active = false;
+    transfer->tx_active = false;
+    transfer->failure = failure;
+    #if DMA_STATISTICS
+    dma_stats_transfer_done(transfer, failure);
+    #endif
+}
+
+void dma_set_priority_arbitration(uint8_t level, bool round_robin) {
+    if (level >= DMA_PRIORITY_LEVEL_COUNT) {
         return;
     }
+    // Each level has a byte in PRICTRL0.
+    uint32_t round_robin_enable = DMAC_PRICTRL0_RRLVLEN0 << (level * 8);
+    if (round_robin) {
+        DMAC->PRICTRL0.reg |= round_robin_enable;
+    } else {
+        DMAC->PRICTRL0.reg &= ~round_robin_enable;
+    }
+}
+
+#ifdef SAM_D5X_E5X
+// Sometimes (silicon bug?) a DMA transfer never starts, and another channel sits with
+// CHSTATUS.reg = 0x3 (BUSY | PENDING).  On the other hand, this is a
+// legitimate state for a DMA channel to be in (apparently), so we can't use that alone as a check.
+// Instead, let's look at the ACTIVE flag.  When DMA is hung, everything in ACTIVE is zeros.
+static bool shared_dma_transfer_hung(dma_transfer_t* transfer) {
+    if (DMAC->ACTIVE.bit.ABUSY) {
+        return false;
+    }
+    return (transfer->rx_active && (DMAC->Channel[transfer->rx_channel].CHSTATUS.reg & 0x3) != 0) ||
+           (transfer->tx_active && (DMAC->Channel[transfer->tx_channel].CHSTATUS.reg & 0x3) != 0);
+}
+
+// Where every channel's write-back descriptor was when the current stall began.
+static uint16_t stall_btcnt[DMA_CHANNEL_COUNT];
+static uint32_t stall_descaddr[DMA_CHANNEL_COUNT];
+
+static void dma_note_stall_start(void) {
+    for (uint8_t i = 0; i < DMA_CHANNEL_COUNT; i++) {
+        stall_btcnt[i] = write_back_descriptors[i].BTCNT.reg;
+        stall_descaddr[i] = write_back_descriptors[i].DESCADDR.reg;
+    }
+}
+
+// Restart only the channels that look stuck rather than every enabled channel so that unrelated
+// streams keep running. Our own channels are only restarted when they haven't moved anything yet
+// because re-enabling starts over from the first descriptor. BUSY | PENDING alone is legitimate
+// for other channels so they must also not have moved since dma_note_stall_start().
+static void dma_kick_stuck_channels(dma_transfer_t* transfer, bool include_own) {
+    for (uint8_t i = 0; i < DMA_CHANNEL_COUNT; i++) {
+        DmacChannel* channel = &DMAC->Channel[i];
+        if (!channel->CHCTRLA.bit.ENABLE) {
+            continue;
+        }
+        bool own = (transfer->rx_active && i == transfer->rx_channel) ||
+                   (transfer->tx_active && i == transfer->tx_channel);
+        bool stuck;
+        if (own) {
+            stuck = include_own && (channel->CHSTATUS.reg & 0x3) != 0;
+        } else {
+            stuck = (channel->CHSTATUS.reg & 0x3) == 0x3 &&
+                    write_back_descriptors[i].BTCNT.reg == stall_btcnt[i] &&
+                    write_back_descriptors[i].DESCADDR.reg == stall_descaddr[i];
+        }
+        if (stuck) {
+            channel->CHCTRLA.bit.ENABLE = 0;
+            channel->CHCTRLA.bit.ENABLE = 1;
+            watchdog_stats.channel_kicks++;
+        }
+    }
+}
+#endif
+
+static void shared_dma_transfer_init(dma_transfer_t* transfer, void* peripheral, uint8_t tx) {
+    transfer->progress = 0;
+    transfer->tx_fill = (uint32_t) tx * 0x01010101u;
+    transfer->rx_status = 0;
+    transfer->tx_status = 0;
+    transfer->complete = false;
+    transfer->callback = NULL;
+    transfer->callback_data = NULL;
+    transfer->peripheral = peripheral;
+    transfer->rx_channel = NO_DMA_CHANNEL;
+    transfer->tx_channel = NO_DMA_CHANNEL;
+    transfer->rx_active = false;
+    transfer->tx_active = false;
+    transfer->failure = 0;
+    transfer->crc_type = DMA_CRC_NONE;
+    transfer->crc = 0;
+    #if DMA_STATISTICS
+    transfer->start_time = dma_stats_time();
+    #endif
+}
 
-    // Allocate an rx dma channel only if we're going to read.
-    uint8_t rx_channel = NO_DMA_CHANNEL;
-    if (buffer_in != NULL) {
-        rx_channel = dma_allocate_non_audio_channel();
-        if (rx_channel == NO_DMA_CHANNEL) {
-            transfer->failure = DMA_FAILURE_NO_CHANNEL_AVAILABLE;
+// Start a transfer that also feeds the CRC engine from the RX channel, or the TX channel when
+// there is no RX.
+static void shared_dma_transfer_start_crc(dma_transfer_t* transfer, void* peripheral,
+                                          const dma_iovec_t* iov_out, size_t iov_out_count, volatile uint32_t* dest,
+                                          volatile uint32_t* src, const dma_iovec_t* iov_in, size_t iov_in_count, uint8_t tx,
+                                          uint8_t crc_type) {
+    shared_dma_transfer_init(transfer, peripheral, tx);
+
+    uint32_t length;
+    if (iov_out != NULL) {
+        length = dma_iovec_length(iov_out, iov_out_count);
+        if (iov_in != NULL && dma_iovec_length(iov_in, iov_in_count) != length) {
+            shared_dma_transfer_fail(transfer, DMA_FAILURE_LENGTH_MISMATCH);
             return;
         }
+    } else {
+        length = dma_iovec_length(iov_in, iov_in_count);
     }
+    transfer->length = length;
 
-    uint32_t beat_size = DMAC_BTCTRL_BEATSIZE_BYTE;
+    uint16_t beat_size = DMAC_BTCTRL_BEATSIZE_BYTE;
+    uint8_t beat_shift = 0;
+    // Flags that apply to the peripheral side of the descriptors.
+    uint16_t peripheral_increment = 0;
     bool sercom = true;
-    bool tx_active = false;
-    bool rx_active = false;
-    uint16_t beat_length = length;
+    // There's always a SERCOM tx DMA channel, though it may be sending only the tx byte if
+    // iov_out is NULL. Allocate an rx dma channel only if we're going to read.
+    bool tx_active = true;
+    bool rx_active = iov_in != NULL;
+    uint8_t tx_trigsrc;
+    uint8_t rx_trigsrc;
     #ifdef SAM_D5X_E5X
     if (peripheral == QSPI) {
-        // Check input alignment on word boundaries.
+        // Use word beats when the buffers, their lengths and the flash address are all on word
+        // boundaries. Otherwise fall back to byte beats which the AHB window handles too.
         // NULLs will pass this test, so no need to check for them separately.
-        if ((((uint32_t) buffer_in) & 0x3) != 0 ||
-            (((uint32_t) buffer_out) & 0x3) != 0) {
-            transfer->failure = DMA_FAILURE_ALIGNMENT;
-            return;
+        if (dma_iovec_aligned(iov_out, iov_out_count, true) &&
+            dma_iovec_aligned(iov_in, iov_in_count, true) &&
+            ((((uint32_t) dest) | ((uint32_t) src)) & 0x3) == 0) {
+            beat_size = DMAC_BTCTRL_BEATSIZE_WORD;
+            beat_shift = 2;
         }
-        beat_size = DMAC_BTCTRL_BEATSIZE_WORD | DMAC_BTCTRL_SRCINC | DMAC_BTCTRL_DSTINC;
-        beat_length /= 4;
+        peripheral_increment = DMAC_BTCTRL_SRCINC | DMAC_BTCTRL_DSTINC;
         sercom = false;
-        if (buffer_out != NULL) {
-            dma_configure(tx_channel, QSPI_DMAC_ID_TX, false);
-            tx_active = true;
-        } else {
-            dma_configure(rx_channel, QSPI_DMAC_ID_RX, false);
-            rx_active = true;
-        }
-
+        tx_active = iov_out != NULL;
+        rx_active = !tx_active;
+        tx_trigsrc = QSPI_DMAC_ID_TX;
+        rx_trigsrc = QSPI_DMAC_ID_RX;
     } else {
     #endif
 
-        // There is always a TX channel.
-        dma_configure(tx_channel, sercom_index(peripheral) * 2 + FIRST_SERCOM_TX_TRIGSRC, false);
-        tx_active = true;
-        if (rx_channel != NO_DMA_CHANNEL) {
-            dma_configure(rx_channel, sercom_index(peripheral) * 2 + FIRST_SERCOM_RX_TRIGSRC, false);
-            rx_active = true;
+        tx_trigsrc = sercom_index(peripheral) * 2 + FIRST_SERCOM_TX_TRIGSRC;
+        rx_trigsrc = sercom_index(peripheral) * 2 + FIRST_SERCOM_RX_TRIGSRC;
+        #ifdef SAM_D5X_E5X
+        // Match the beats to the SERCOM's data size. In 32-bit mode every beat is a whole word.
+        if (((Sercom*) peripheral)->SPI.CTRLC.bit.DATA32B) {
+            if (!dma_iovec_aligned(iov_out, iov_out_count, true) ||
+                !dma_iovec_aligned(iov_in, iov_in_count, true)) {
+                shared_dma_transfer_fail(transfer, DMA_FAILURE_ALIGNMENT);
+                return;
+            }
+            beat_size = DMAC_BTCTRL_BEATSIZE_WORD;
+            beat_shift = 2;
         }
+        #endif
 
     #ifdef SAM_D5X_E5X
     }
     #endif
+    transfer->sercom = sercom;
+
+    if (tx_active) {
+        transfer->tx_channel = dma_allocate_non_audio_channel();
+        if (transfer->tx_channel == NO_DMA_CHANNEL) {
+            shared_dma_transfer_fail(transfer, DMA_FAILURE_NO_CHANNEL_AVAILABLE);
+            return;
+        }
+        dma_configure(transfer->tx_channel, tx_trigsrc, false);
+    }
+    if (rx_active) {
+        transfer->rx_channel = dma_allocate_non_audio_channel();
+        if (transfer->rx_channel == NO_DMA_CHANNEL) {
+            shared_dma_transfer_fail(transfer, DMA_FAILURE_NO_CHANNEL_AVAILABLE);
+            return;
+        }
+        dma_configure(transfer->rx_channel, rx_trigsrc, false);
+    }
+    transfer->tx_active = tx_active;
+    transfer->rx_active = rx_active;
+    uint8_t rx_channel = transfer->rx_channel;
+    uint8_t tx_channel = transfer->tx_channel;
 
     // Set up RX first.
     if (rx_active) {
-        DmacDescriptor* rx_descriptor = &dma_descriptors[rx_channel];
-        rx_descriptor->BTCTRL.reg = beat_size | DMAC_BTCTRL_DSTINC;
-        rx_descriptor->BTCNT.reg = beat_length;
-        rx_descriptor->SRCADDR.reg = ((uint32_t) src);
-        #ifdef SAM_D5X_E5X
-        if (peripheral == QSPI) {
-            rx_descriptor->SRCADDR.reg = ((uint32_t) src + length);
+        DmacDescriptor* tail = NULL;
+        uint32_t src_address = (uint32_t) src;
+        for (size_t i = 0; i < iov_in_count; i++) {
+            uint16_t btctrl = beat_size | peripheral_increment | DMAC_BTCTRL_DSTINC;
+            uint32_t dst_address = (uint32_t) iov_in[i].buffer;
+            if (sercom && iov_in[i].buffer == NULL) {
+                btctrl = beat_size;
+                dst_address = (uint32_t) &transfer->rx_discard;
+            }
+            if (!dma_chain_append(rx_channel, &tail, btctrl, src_address, dst_address, iov_in[i].length >> beat_shift)) {
+                shared_dma_transfer_fail(transfer, DMA_FAILURE_NO_DESCRIPTOR_AVAILABLE);
+                return;
+            }
+            if (peripheral_increment != 0) {
+                src_address += iov_in[i].length;
+            }
+        }
+        if (tail == NULL) {
+            shared_dma_transfer_fail(transfer, DMA_FAILURE_INVALID_LENGTH);
+            return;
         }
-        #endif
-        rx_descriptor->DSTADDR.reg = ((uint32_t)buffer_in + length);
-        rx_descriptor->BTCTRL.bit.VALID = true;
     }
 
     // Set up TX second.
     if (tx_active) {
-        DmacDescriptor* tx_descriptor = &dma_descriptors[tx_channel];
-        tx_descriptor->BTCTRL.reg = beat_size;
-        tx_descriptor->BTCNT.reg = beat_length;
-
-        if (buffer_out != NULL) {
-            tx_descriptor->SRCADDR.reg = ((uint32_t)buffer_out + length);
-            tx_descriptor->BTCTRL.reg |= DMAC_BTCTRL_SRCINC;
+        DmacDescriptor* tail = NULL;
+        bool ok = true;
+        if (iov_out != NULL) {
+            uint32_t dest_address = (uint32_t) dest;
+            for (size_t i = 0; i < iov_out_count && ok; i++) {
+                uint16_t btctrl = beat_size | peripheral_increment | DMAC_BTCTRL_SRCINC;
+                uint32_t src_address = (uint32_t) iov_out[i].buffer;
+                if (sercom && iov_out[i].buffer == NULL) {
+                    btctrl = beat_size;
+                    src_address = (uint32_t) &transfer->tx_fill;
+                }
+                ok = dma_chain_append(tx_channel, &tail, btctrl, src_address, dest_address, iov_out[i].length >> beat_shift);
+                if (peripheral_increment != 0) {
+                    dest_address += iov_out[i].length;
+                }
+            }
         } else {
-            tx_descriptor->SRCADDR.reg = ((uint32_t) &tx);
+            ok = dma_chain_append(tx_channel, &tail, beat_size,
+                                  (uint32_t) &transfer->tx_fill, (uint32_t) dest, length >> beat_shift);
+        }
+        if (!ok) {
+            shared_dma_transfer_fail(transfer, DMA_FAILURE_NO_DESCRIPTOR_AVAILABLE);
+            return;
+        }
+        if (tail == NULL) {
+            shared_dma_transfer_fail(transfer, DMA_FAILURE_INVALID_LENGTH);
+            return;
         }
-        tx_descriptor->DSTADDR.reg = ((uint32_t) dest);
-        tx_descriptor->BTCTRL.bit.VALID = true;
     }
+
+    if (crc_type != DMA_CRC_NONE) {
+        if (!dma_crc_claim(crc_type, rx_active ? rx_channel : tx_channel, beat_size)) {
+            shared_dma_transfer_fail(transfer, DMA_FAILURE_CRC_BUSY);
+            return;
+        }
+        transfer->crc_type = crc_type;
+    }
+
     if (sercom) {
         SercomSpi *s = &((Sercom*) peripheral)->SPI;
         // TODO: test if this operation is necessary or if it's just a waste of time and space
@@ -217,6 +773,9 @@ void shared_dma_transfer_start(dma_transfer_t *transfer, void* peripheral, const
         dma_enable_channel(tx_channel);
     }
     mp_hal_enable_all_interrupts();
+    #if DMA_STATISTICS
+    dma_trace_add(transfer, dma_stats_time(), 0);
+    #endif
 
     if (!sercom) {
         if (rx_active) {
@@ -225,41 +784,40 @@ void shared_dma_transfer_start(dma_transfer_t *transfer, void* peripheral, const
     }
 
     #ifdef SAM_D5X_E5X
-    // Sometimes (silicon bug?) this DMA transfer never starts, and another channel sits with
-    // CHSTATUS.reg = 0x3 (BUSY | PENDING).  On the other hand, this is a
-    // legitimate state for a DMA channel to be in (apparently), so we can't use that alone as a check.
-    // Instead, let's look at the ACTIVE flag.  When DMA is hung, everything in ACTIVE is zeros.
     bool is_okay = false;
+    dma_note_stall_start();
     for (int i = 0; i < 10 && !is_okay; i++) {
-        bool complete = true;
-        if (rx_active) {
-            if (DMAC->Channel[rx_channel].CHSTATUS.reg & 0x3)
-                complete = false;
-        }
-        if (tx_active) {
-            if (DMAC->Channel[tx_channel].CHSTATUS.reg & 0x3)
-                complete = false;
-        }
-        is_okay = is_okay || (DMAC->ACTIVE.bit.ABUSY || complete);
+        is_okay = !shared_dma_transfer_hung(transfer);
     }
     if (!is_okay) {
-        for (int i = 0; i < DMA_CHANNEL_COUNT; i++) {
-            if(DMAC->Channel[i].CHCTRLA.bit.ENABLE) {
-                DMAC->Channel[i].CHCTRLA.bit.ENABLE = 0;
-                DMAC->Channel[i].CHCTRLA.bit.ENABLE = 1;
-            }
-        }
+        watchdog_stats.hangs++;
+        dma_kick_stuck_channels(transfer, true);
     }
     #endif
-    transfer->peripheral = peripheral;
-    transfer->length = length;
-    transfer->rx_channel = rx_channel;
-    transfer->tx_channel = tx_channel;
-    transfer->rx_active = rx_active;
-    transfer->tx_active = tx_active;
-    transfer->sercom = sercom;
-    transfer->failure = 0;
-    transfer->progress = 0;
+}
+
+// Do write and read simultaneously. If iov_out is NULL, write the tx byte over and over.
+// If iov_out is a real list, ignore tx. When both lists are given their total lengths must match.
+// Each list becomes one chain of descriptors so the whole list moves without the CPU.
+// DMAs iov_out -> dest
+// DMAs src -> iov_in
+void shared_dma_transfer_start_iovec(dma_transfer_t* transfer, void* peripheral,
+                                     const dma_iovec_t* iov_out, size_t iov_out_count, volatile uint32_t* dest,
+                                     volatile uint32_t* src, const dma_iovec_t* iov_in, size_t iov_in_count, uint8_t tx) {
+    shared_dma_transfer_start_crc(transfer, peripheral, iov_out, iov_out_count, dest, src, iov_in, iov_in_count, tx,
+                                  DMA_CRC_NONE);
+}
+
+// Do write and read simultaneously. If buffer_out is NULL, write the tx byte over and over.
+// If buffer_out is a real buffer, ignore tx.
+// DMAs buffer_out -> dest
+// DMAs src -> buffer_in
+void shared_dma_transfer_start(dma_transfer_t *transfer, void* peripheral, const uint8_t* buffer_out, volatile uint32_t* dest, volatile uint32_t* src, uint8_t* buffer_in, uint32_t length, uint8_t tx) {
+    dma_iovec_t iov_out = {(void*) buffer_out, length};
+    dma_iovec_t iov_in = {buffer_in, length};
+    shared_dma_transfer_start_iovec(transfer, peripheral,
+                                    buffer_out != NULL ? &iov_out : NULL, 1, dest,
+                                    src, buffer_in != NULL ? &iov_in : NULL, 1, tx);
 }
 
 bool shared_dma_transfer_finished(dma_transfer_t* transfer) {
@@ -268,7 +826,7 @@ bool shared_dma_transfer_finished(dma_transfer_t* transfer) {
     }
 
     if (transfer->progress < 1 && transfer->rx_active) {
-        if ((dma_transfer_status(transfer->rx_channel) & 0x3) == 0) {
+        if (((dma_transfer_status(transfer->rx_channel) | transfer->rx_status) & 0x3) == 0) {
             // RX hasn't finished.
             return false;
         }
@@ -276,7 +834,7 @@ bool shared_dma_transfer_finished(dma_transfer_t* transfer) {
         transfer->progress = 1;
     }
     if (transfer->progress < 2 && transfer->tx_active) {
-        if ((dma_transfer_status(transfer->tx_channel) & 0x3) == 0) {
+        if (((dma_transfer_status(transfer->tx_channel) | transfer->tx_status) & 0x3) == 0) {
             // TX hasn't finished.
             return false;
         }
@@ -307,19 +865,210 @@ bool shared_dma_transfer_finished(dma_transfer_t* transfer) {
 }
 
 int shared_dma_transfer_close(dma_transfer_t* transfer) {
+    if (transfer->crc_type != DMA_CRC_NONE) {
+        transfer->crc = dma_crc_release(transfer->crc_type);
+    }
     // It is not an error if either is NO_DMA_CHANNEL.
     dma_free_channel(transfer->tx_channel);
     dma_free_channel(transfer->rx_channel);
 
+    int result;
+    if (transfer->failure != 0) {
+        result = transfer->failure;
+    } else if ((!transfer->rx_active || (dma_transfer_status(transfer->rx_channel) | transfer->rx_status) == DMAC_CHINTFLAG_TCMPL) &&
+               (!transfer->tx_active || (dma_transfer_status(transfer->tx_channel) | transfer->tx_status) == DMAC_CHINTFLAG_TCMPL)) {
+        result = transfer->length;
+    } else {
+        result = DMA_FAILURE_INCOMPLETE;
+    }
+    #if DMA_STATISTICS
+    dma_stats_transfer_done(transfer, result);
+    #endif
+    return result;
+}
+
+static void shared_dma_transfer_interrupt(uint8_t channel, uint8_t flags, void* data) {
+    dma_transfer_t* transfer = (dma_transfer_t*) data;
+    if (transfer->rx_active && channel == transfer->rx_channel) {
+        transfer->rx_status |= flags;
+    } else {
+        transfer->tx_status |= flags;
+    }
+    if ((flags & DMAC_CHINTFLAG_TERR) != 0) {
+        // The other channel may never finish so give up on the whole transfer.
+        transfer->failure = DMA_FAILURE_INCOMPLETE;
+    } else if ((transfer->rx_active && transfer->rx_status == 0) ||
+               (transfer->tx_active && transfer->tx_status == 0)) {
+        return;
+    }
+    // Both channels are done so this only waits for the last SERCOM byte to shift out.
+    while (!shared_dma_transfer_finished(transfer)) {}
+    int32_t result = shared_dma_transfer_close(transfer);
+    transfer->complete = true;
+    if (transfer->callback != NULL) {
+        transfer->callback(transfer, result, transfer->callback_data);
+    }
+}
+
+static void shared_dma_transfer_enable_callback(dma_transfer_t* transfer, dma_transfer_callback_t callback, void* callback_data) {
     if (transfer->failure != 0) {
+        return;
+    }
+    transfer->callback = callback;
+    transfer->callback_data = callback_data;
+    uint8_t interrupt_flags = DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR;
+    if (transfer->rx_active) {
+        dma_set_channel_callback(transfer->rx_channel, interrupt_flags, shared_dma_transfer_interrupt, transfer);
+    }
+    if (transfer->tx_active) {
+        dma_set_channel_callback(transfer->tx_channel, interrupt_flags, shared_dma_transfer_interrupt, transfer);
+    }
+}
+
+// Same as shared_dma_transfer_start() except that the DMAC interrupt finishes and closes the
+// transfer and then calls callback. Check transfer->failure afterwards to see if it started.
+void shared_dma_transfer_start_async(dma_transfer_t* transfer, void* peripheral, const uint8_t* buffer_out, volatile uint32_t* dest, volatile uint32_t* src, uint8_t* buffer_in, uint32_t length, uint8_t tx,
+                                     dma_transfer_callback_t callback, void* callback_data) {
+    shared_dma_transfer_start(transfer, peripheral, buffer_out, dest, src, buffer_in, length, tx);
+    shared_dma_transfer_enable_callback(transfer, callback, callback_data);
+}
+
+void shared_dma_transfer_start_iovec_async(dma_transfer_t* transfer, void* peripheral,
+                                           const dma_iovec_t* iov_out, size_t iov_out_count, volatile uint32_t* dest,
+                                           volatile uint32_t* src, const dma_iovec_t* iov_in, size_t iov_in_count, uint8_t tx,
+                                           dma_transfer_callback_t callback, void* callback_data) {
+    shared_dma_transfer_start_iovec(transfer, peripheral, iov_out, iov_out_count, dest, src, iov_in, iov_in_count, tx);
+    shared_dma_transfer_enable_callback(transfer, callback, callback_data);
+}
+
+// The widest beat that every address and the length line up with.
+static uint16_t dma_memory_beat_size(uint32_t alignment, uint8_t* beat_shift) {
+    if ((alignment & 0x3) == 0) {
+        *beat_shift = 2;
+        return DMAC_BTCTRL_BEATSIZE_WORD;
+    } else if ((alignment & 0x1) == 0) {
+        *beat_shift = 1;
+        return DMAC_BTCTRL_BEATSIZE_HWORD;
+    }
+    *beat_shift = 0;
+    return DMAC_BTCTRL_BEATSIZE_BYTE;
+}
+
+// Copy with src != NULL or fill with value. Finishes on the CPU when the DMA isn't worth it.
+static int32_t dma_memory_start(dma_transfer_t* transfer, void* dest, const void* src, uint8_t value, uint32_t length,
+                                dma_transfer_callback_t callback, void* callback_data) {
+    shared_dma_transfer_init(transfer, NULL, value);
+    transfer->sercom = false;
+    transfer->length = length;
+
+    uint8_t channel = NO_DMA_CHANNEL;
+    if (length >= DMA_MEMORY_MIN_LENGTH) {
+        channel = dma_allocate_non_audio_channel();
+    }
+    if (channel == NO_DMA_CHANNEL) {
+        if (src != NULL) {
+            memcpy(dest, src, length);
+        } else {
+            memset(dest, value, length);
+        }
+        transfer->complete = true;
+        if (callback != NULL) {
+            callback(transfer, length, callback_data);
+        }
+        return 0;
+    }
+    transfer->tx_channel = channel;
+    transfer->tx_active = true;
+    dma_configure_software(channel);
+
+    uint8_t beat_shift;
+    uint16_t beat_size = dma_memory_beat_size(((uint32_t) dest) | ((uint32_t) src) | length, &beat_shift);
+    uint16_t btctrl = beat_size | DMAC_BTCTRL_DSTINC;
+    uint32_t src_address = (uint32_t) &transfer->tx_fill;
+    if (src != NULL) {
+        btctrl |= DMAC_BTCTRL_SRCINC;
+        src_address = (uint32_t) src;
+    }
+    DmacDescriptor* tail = NULL;
+    if (!dma_chain_append(channel, &tail, btctrl, src_address, (uint32_t) dest, length >> beat_shift)) {
+        shared_dma_transfer_fail(transfer, DMA_FAILURE_NO_DESCRIPTOR_AVAILABLE);
         return transfer->failure;
     }
 
-    if ((!transfer->rx_active || dma_transfer_status(transfer->rx_channel) == DMAC_CHINTFLAG_TCMPL) &&
-        (!transfer->tx_active || dma_transfer_status(transfer->tx_channel) == DMAC_CHINTFLAG_TCMPL)) {
-        return transfer->length;
+    dma_enable_channel(channel);
+    #if DMA_STATISTICS
+    dma_trace_add(transfer, dma_stats_time(), 0);
+    #endif
+    // Hook up the interrupt before the trigger so even a short job can't finish unnoticed.
+    shared_dma_transfer_enable_callback(transfer, callback, callback_data);
+    DMAC->SWTRIGCTRL.reg |= (1 << channel);
+    return 0;
+}
+
+int32_t dma_memcpy_async(dma_transfer_t* transfer, void* dest, const void* src, uint32_t length,
+                         dma_transfer_callback_t callback, void* callback_data) {
+    return dma_memory_start(transfer, dest, src, 0, length, callback, callback_data);
+}
+
+int32_t dma_memset_async(dma_transfer_t* transfer, void* dest, uint8_t value, uint32_t length,
+                         dma_transfer_callback_t callback, void* callback_data) {
+    return dma_memory_start(transfer, dest, NULL, value, length, callback, callback_data);
+}
+
+// Beats left in the current block of each channel. It changes as long as the transfer is moving.
+static uint32_t shared_dma_transfer_beats_left(dma_transfer_t* transfer) {
+    uint32_t beats_left = 0;
+    if (transfer->rx_active) {
+        beats_left += dma_write_back_descriptor(transfer->rx_channel)->BTCNT.reg;
+    }
+    if (transfer->tx_active) {
+        beats_left += dma_write_back_descriptor(transfer->tx_channel)->BTCNT.reg << 16;
+    }
+    return beats_left;
+}
+
+// Waits for the transfer to finish unless it stops moving for DMA_WATCHDOG_STALL_POLLS polls.
+static int32_t shared_dma_transfer_wait(dma_transfer_t* transfer) {
+    if (transfer->failure != 0) {
+        return transfer->failure;
+    }
+    uint32_t beats_left = shared_dma_transfer_beats_left(transfer);
+    uint32_t stalled_polls = 0;
+    #ifdef SAM_D5X_E5X
+    bool moved = false;
+    #endif
+    while (!shared_dma_transfer_finished(transfer)) {
+        uint32_t now_left = shared_dma_transfer_beats_left(transfer);
+        if (now_left != beats_left) {
+            beats_left = now_left;
+            stalled_polls = 0;
+            #ifdef SAM_D5X_E5X
+            moved = true;
+            #endif
+            continue;
+        }
+        stalled_polls++;
+        #ifdef SAM_D5X_E5X
+        if (stalled_polls == 1) {
+            dma_note_stall_start();
+        }
+        if (stalled_polls == DMA_WATCHDOG_STALL_POLLS / 2 && shared_dma_transfer_hung(transfer)) {
+            watchdog_stats.hangs++;
+            dma_kick_stuck_channels(transfer, !moved);
+        }
+        #endif
+        if (stalled_polls >= DMA_WATCHDOG_STALL_POLLS) {
+            watchdog_stats.timeouts++;
+            transfer->failure = DMA_FAILURE_TIMEOUT;
+            break;
+        }
     }
-    return DMA_FAILURE_INCOMPLETE;
+
+    return shared_dma_transfer_close(transfer);
+}
+
+void dma_get_watchdog_stats(dma_watchdog_stats_t* stats) {
+    *stats = watchdog_stats;
 }
 
 // Do write and read simultaneously. If buffer_out is NULL, write the tx byte over and over.
@@ -332,12 +1081,7 @@ static int32_t shared_dma_transfer(void* peripheral,
                                    uint32_t length, uint8_t tx) {
     dma_transfer_t transfer;
     shared_dma_transfer_start(&transfer, peripheral, buffer_out, dest, src, buffer_in, length, tx);
-    if (transfer.failure != 0) {
-        return transfer.failure;
-    }
-    while (!shared_dma_transfer_finished(&transfer)) {}
-
-    return shared_dma_transfer_close(&transfer);
+    return shared_dma_transfer_wait(&transfer);
 }
 
 int32_t sercom_dma_transfer(Sercom* sercom, const uint8_t* buffer_out, uint8_t* buffer_in,
@@ -354,12 +1098,292 @@ int32_t sercom_dma_read(Sercom* sercom, uint8_t* buffer, uint32_t length, uint8_
 }
 
 #ifdef SAM_D5X_E5X
+// Returns the number of bytes before buffer is word aligned or 0 if the buffer and the flash
+// address can't both be word aligned. The DMA falls back to byte beats then.
+static uint32_t qspi_dma_head_length(uint32_t address, const uint8_t* buffer, uint32_t length) {
+    if (((address ^ (uint32_t) buffer) & 0x3) != 0) {
+        return 0;
+    }
+    uint32_t head = (4 - (address & 0x3)) & 0x3;
+    return head < length ? head : length;
+}
+
+// The CPU copies the unaligned head and tail through the AHB window so the DMA can use word beats
+// for the rest. This avoids bounce buffers for unaligned filesystem reads.
 int32_t qspi_dma_write(uint32_t address, const uint8_t* buffer, uint32_t length) {
-    return shared_dma_transfer(QSPI, buffer, (uint32_t*) (QSPI_AHB + address), NULL, NULL, length, 0);
+    uint32_t head = qspi_dma_head_length(address, buffer, length);
+    uint32_t body = (length - head) & ~0x3;
+    uint32_t tail = length - head - body;
+    if (head > 0) {
+        memcpy((uint8_t*) (QSPI_AHB + address), buffer, head);
+    }
+    if (body > 0) {
+        int32_t result = shared_dma_transfer(QSPI, buffer + head, (uint32_t*) (QSPI_AHB + address + head), NULL, NULL, body, 0);
+        if (result < 0) {
+            return result;
+        }
+    }
+    if (tail > 0) {
+        memcpy((uint8_t*) (QSPI_AHB + address + head + body), buffer + head + body, tail);
+    }
+    return length;
 }
 
 int32_t qspi_dma_read(uint32_t address, uint8_t* buffer, uint32_t length) {
-    return shared_dma_transfer(QSPI, NULL, NULL, (uint32_t*) (QSPI_AHB + address), buffer, length, 0);
+    uint32_t head = qspi_dma_head_length(address, buffer, length);
+    uint32_t body = (length - head) & ~0x3;
+    uint32_t tail = length - head - body;
+    if (head > 0) {
+        memcpy(buffer, (uint8_t*) (QSPI_AHB + address), head);
+    }
+    if (body > 0) {
+        int32_t result = shared_dma_transfer(QSPI, NULL, NULL, (uint32_t*) (QSPI_AHB + address + head), buffer + head, body, 0);
+        if (result < 0) {
+            return result;
+        }
+    }
+    if (tail > 0) {
+        memcpy(buffer + head + body, (uint8_t*) (QSPI_AHB + address + head + body), tail);
+    }
+    return length;
+}
+#endif
+
+#ifdef SAM_D5X_E5X
+// Transfers shorter than this aren't worth switching the SERCOM's data size for.
+#define SERCOM_DMA_32_MIN_LENGTH 16
+
+// CTRLC is enable-protected so the SERCOM has to be off to change the data size.
+static void sercom_spi_set_data32(Sercom* sercom, bool data32) {
+    SercomSpi* spi = &sercom->SPI;
+    spi->CTRLA.bit.ENABLE = 0;
+    while (spi->SYNCBUSY.bit.ENABLE != 0) {}
+    spi->CTRLC.bit.DATA32B = data32;
+    spi->LENGTH.reg = 0;
+    spi->CTRLA.bit.ENABLE = 1;
+    while (spi->SYNCBUSY.bit.ENABLE != 0) {}
+}
+
+static void sercom_spi_transfer_bytes(Sercom* sercom, const uint8_t* buffer_out, uint8_t* buffer_in, uint32_t length, uint8_t tx) {
+    SercomSpi* spi = &sercom->SPI;
+    for (uint32_t i = 0; i < length; i++) {
+        while (spi->INTFLAG.bit.DRE == 0) {}
+        spi->DATA.reg = buffer_out != NULL ? buffer_out[i] : tx;
+        while (spi->INTFLAG.bit.TXC == 0) {}
+        uint8_t data = spi->DATA.reg;
+        if (buffer_in != NULL) {
+            buffer_in[i] = data;
+        }
+    }
+}
+
+static int32_t sercom_dma_transfer_32_impl(Sercom* sercom, const uint8_t* buffer_out, uint8_t* buffer_in, uint32_t length, uint8_t tx) {
+    uint32_t address = (uint32_t) (buffer_out != NULL ? buffer_out : buffer_in);
+    uint32_t head = (4 - (address & 0x3)) & 0x3;
+    // Both buffers need the same alignment for the body to be aligned in both.
+    if (length < SERCOM_DMA_32_MIN_LENGTH ||
+        (buffer_out != NULL && buffer_in != NULL && ((((uint32_t) buffer_out) ^ ((uint32_t) buffer_in)) & 0x3) != 0)) {
+        return shared_dma_transfer(sercom, buffer_out, &sercom->SPI.DATA.reg, buffer_in != NULL ? &sercom->SPI.DATA.reg : NULL, buffer_in, length, tx);
+    }
+    uint32_t body = (length - head) & ~0x3;
+    uint32_t tail = length - head - body;
+
+    sercom_spi_transfer_bytes(sercom, buffer_out, buffer_in, head, tx);
+
+    sercom_spi_set_data32(sercom, true);
+    int32_t result = shared_dma_transfer(sercom,
+                                         buffer_out != NULL ? buffer_out + head : NULL, &sercom->SPI.DATA.reg,
+                                         buffer_in != NULL ? &sercom->SPI.DATA.reg : NULL, buffer_in != NULL ? buffer_in + head : NULL,
+                                         body, tx);
+    sercom_spi_set_data32(sercom, false);
+    if (result < 0) {
+        return result;
+    }
+
+    sercom_spi_transfer_bytes(sercom,
+                              buffer_out != NULL ? buffer_out + head + body : NULL,
+                              buffer_in != NULL ? buffer_in + head + body : NULL,
+                              tail, tx);
+    return length;
+}
+
+int32_t sercom_dma_write_32(Sercom* sercom, const uint8_t* buffer, uint32_t length) {
+    return sercom_dma_transfer_32_impl(sercom, buffer, NULL, length, 0);
+}
+
+int32_t sercom_dma_read_32(Sercom* sercom, uint8_t* buffer, uint32_t length, uint8_t tx) {
+    return sercom_dma_transfer_32_impl(sercom, NULL, buffer, length, tx);
+}
+
+int32_t sercom_dma_transfer_32(Sercom* sercom, const uint8_t* buffer_out, uint8_t* buffer_in, uint32_t length) {
+    return sercom_dma_transfer_32_impl(sercom, buffer_out, buffer_in, length, 0);
+}
+#endif
+
+int32_t sercom_dma_write_iovec(Sercom* sercom, const dma_iovec_t* iov, size_t iov_count) {
+    dma_transfer_t transfer;
+    shared_dma_transfer_start_iovec(&transfer, sercom, iov, iov_count, &sercom->SPI.DATA.reg, NULL, NULL, 0, 0);
+    return shared_dma_transfer_wait(&transfer);
+}
+
+int32_t sercom_dma_read_iovec(Sercom* sercom, const dma_iovec_t* iov, size_t iov_count, uint8_t tx) {
+    dma_transfer_t transfer;
+    shared_dma_transfer_start_iovec(&transfer, sercom, NULL, 0, &sercom->SPI.DATA.reg, &sercom->SPI.DATA.reg, iov, iov_count, tx);
+    return shared_dma_transfer_wait(&transfer);
+}
+
+int32_t sercom_dma_write_crc(Sercom* sercom, const uint8_t* buffer, uint32_t length, uint8_t crc_type, uint32_t* crc) {
+    dma_transfer_t transfer;
+    dma_iovec_t iov = {(void*) buffer, length};
+    shared_dma_transfer_start_crc(&transfer, sercom, &iov, 1, &sercom->SPI.DATA.reg, NULL, NULL, 0, 0, crc_type);
+    int32_t result = shared_dma_transfer_wait(&transfer);
+    *crc = transfer.crc;
+    return result;
+}
+
+int32_t sercom_dma_read_crc(Sercom* sercom, uint8_t* buffer, uint32_t length, uint8_t tx, uint8_t crc_type, uint32_t* crc) {
+    dma_transfer_t transfer;
+    dma_iovec_t iov = {buffer, length};
+    shared_dma_transfer_start_crc(&transfer, sercom, NULL, 0, &sercom->SPI.DATA.reg, &sercom->SPI.DATA.reg, &iov, 1, tx,
+                                  crc_type);
+    int32_t result = shared_dma_transfer_wait(&transfer);
+    *crc = transfer.crc;
+    return result;
+}
+
+#ifdef SAM_D5X_E5X
+// Unlike qspi_dma_write() and qspi_dma_read() the unaligned ends aren't copied by the CPU so that
+// the CRC sees every byte. Unaligned transfers use byte beats throughout.
+int32_t qspi_dma_write_crc(uint32_t address, const uint8_t* buffer, uint32_t length, uint8_t crc_type, uint32_t* crc) {
+    dma_transfer_t transfer;
+    dma_iovec_t iov = {(void*) buffer, length};
+    shared_dma_transfer_start_crc(&transfer, QSPI, &iov, 1, (uint32_t*) (QSPI_AHB + address), NULL, NULL, 0, 0, crc_type);
+    int32_t result = shared_dma_transfer_wait(&transfer);
+    *crc = transfer.crc;
+    return result;
+}
+
+int32_t qspi_dma_read_crc(uint32_t address, uint8_t* buffer, uint32_t length, uint8_t crc_type, uint32_t* crc) {
+    dma_transfer_t transfer;
+    dma_iovec_t iov = {buffer, length};
+    shared_dma_transfer_start_crc(&transfer, QSPI, NULL, 0, NULL, (uint32_t*) (QSPI_AHB + address), &iov, 1, 0, crc_type);
+    int32_t result = shared_dma_transfer_wait(&transfer);
+    *crc = transfer.crc;
+    return result;
+}
+#endif
+
+// Moves the buffer into a scratch word so that the data only passes through the CRC engine.
+int32_t dma_crc(const void* buffer, uint32_t length, uint8_t crc_type, uint32_t* crc) {
+    dma_transfer_t transfer;
+    shared_dma_transfer_init(&transfer, NULL, 0);
+    transfer.sercom = false;
+    transfer.length = length;
+    transfer.tx_channel = dma_allocate_non_audio_channel();
+    if (transfer.tx_channel == NO_DMA_CHANNEL) {
+        return DMA_FAILURE_NO_CHANNEL_AVAILABLE;
+    }
+    transfer.tx_active = true;
+    dma_configure_software(transfer.tx_channel);
+
+    uint8_t beat_shift;
+    uint16_t beat_size = dma_memory_beat_size(((uint32_t) buffer) | length, &beat_shift);
+    DmacDescriptor* tail = NULL;
+    if (!dma_chain_append(transfer.tx_channel, &tail, beat_size | DMAC_BTCTRL_SRCINC,
+                          (uint32_t) buffer, (uint32_t) &transfer.rx_discard, length >> beat_shift)) {
+        shared_dma_transfer_fail(&transfer, DMA_FAILURE_NO_DESCRIPTOR_AVAILABLE);
+        return transfer.failure;
+    }
+    if (tail == NULL) {
+        shared_dma_transfer_fail(&transfer, DMA_FAILURE_INVALID_LENGTH);
+        return transfer.failure;
+    }
+    if (!dma_crc_claim(crc_type, transfer.tx_channel, beat_size)) {
+        shared_dma_transfer_fail(&transfer, DMA_FAILURE_CRC_BUSY);
+        return transfer.failure;
+    }
+    transfer.crc_type = crc_type;
+
+    dma_enable_channel(transfer.tx_channel);
+    #if DMA_STATISTICS
+    dma_trace_add(&transfer, dma_stats_time(), 0);
+    #endif
+    DMAC->SWTRIGCTRL.reg |= (1 << transfer.tx_channel);
+    int32_t result = shared_dma_transfer_wait(&transfer);
+    *crc = transfer.crc;
+    return result;
+}
+
+// The command and response are one scatter-gather list in each direction. The response half of
+// the output and the command half of the input use NULL buffers for the fill and discard.
+int32_t sercom_dma_command(Sercom* sercom, const uint8_t* command, uint32_t command_length,
+                           uint8_t* response, uint32_t response_length, uint8_t fill) {
+    dma_transfer_t transfer;
+    dma_iovec_t iov_out[2] = {{(void*) command, command_length}, {NULL, response_length}};
+    dma_iovec_t iov_in[2] = {{NULL, command_length}, {response, response_length}};
+    shared_dma_transfer_start_iovec(&transfer, sercom, iov_out, 2, &sercom->SPI.DATA.reg,
+                                    &sercom->SPI.DATA.reg, iov_in, 2, fill);
+    return shared_dma_transfer_wait(&transfer);
+}
+
+#ifdef SAM_D5X_E5X
+int32_t qspi_dma_write_iovec(uint32_t address, const dma_iovec_t* iov, size_t iov_count) {
+    dma_transfer_t transfer;
+    shared_dma_transfer_start_iovec(&transfer, QSPI, iov, iov_count, (uint32_t*) (QSPI_AHB + address), NULL, NULL, 0, 0);
+    return shared_dma_transfer_wait(&transfer);
+}
+
+int32_t qspi_dma_read_iovec(uint32_t address, const dma_iovec_t* iov, size_t iov_count) {
+    dma_transfer_t transfer;
+    shared_dma_transfer_start_iovec(&transfer, QSPI, NULL, 0, NULL, (uint32_t*) (QSPI_AHB + address), iov, iov_count, 0);
+    return shared_dma_transfer_wait(&transfer);
+}
+#endif
+
+int32_t sercom_dma_transfer_async(dma_transfer_t* transfer, Sercom* sercom, const uint8_t* buffer_out, uint8_t* buffer_in, uint32_t length,
+                                  dma_transfer_callback_t callback, void* callback_data) {
+    shared_dma_transfer_start_async(transfer, sercom, buffer_out, &sercom->SPI.DATA.reg, &sercom->SPI.DATA.reg, buffer_in, length, 0,
+                                    callback, callback_data);
+    return transfer->failure;
+}
+
+int32_t sercom_dma_write_async(dma_transfer_t* transfer, Sercom* sercom, const uint8_t* buffer, uint32_t length,
+                               dma_transfer_callback_t callback, void* callback_data) {
+    shared_dma_transfer_start_async(transfer, sercom, buffer, &sercom->SPI.DATA.reg, NULL, NULL, length, 0,
+                                    callback, callback_data);
+    return transfer->failure;
+}
+
+int32_t sercom_dma_read_async(dma_transfer_t* transfer, Sercom* sercom, uint8_t* buffer, uint32_t length, uint8_t tx,
+                              dma_transfer_callback_t callback, void* callback_data) {
+    shared_dma_transfer_start_async(transfer, sercom, NULL, &sercom->SPI.DATA.reg, &sercom->SPI.DATA.reg, buffer, length, tx,
+                                    callback, callback_data);
+    return transfer->failure;
+}
+
+int32_t sercom_dma_command_async(dma_transfer_t* transfer, Sercom* sercom, const uint8_t* command, uint32_t command_length,
+                                 uint8_t* response, uint32_t response_length, uint8_t fill,
+                                 dma_transfer_callback_t callback, void* callback_data) {
+    dma_iovec_t iov_out[2] = {{(void*) command, command_length}, {NULL, response_length}};
+    dma_iovec_t iov_in[2] = {{NULL, command_length}, {response, response_length}};
+    shared_dma_transfer_start_iovec_async(transfer, sercom, iov_out, 2, &sercom->SPI.DATA.reg,
+                                          &sercom->SPI.DATA.reg, iov_in, 2, fill, callback, callback_data);
+    return transfer->failure;
+}
+
+#ifdef SAM_D5X_E5X
+int32_t qspi_dma_write_async(dma_transfer_t* transfer, uint32_t address, const uint8_t* buffer, uint32_t length,
+                             dma_transfer_callback_t callback, void* callback_data) {
+    shared_dma_transfer_start_async(transfer, QSPI, buffer, (uint32_t*) (QSPI_AHB + address), NULL, NULL, length, 0,
+                                    callback, callback_data);
+    return transfer->failure;
+}
+
+int32_t qspi_dma_read_async(dma_transfer_t* transfer, uint32_t address, uint8_t* buffer, uint32_t length,
+                            dma_transfer_callback_t callback, void* callback_data) {
+    shared_dma_transfer_start_async(transfer, QSPI, NULL, NULL, (uint32_t*) (QSPI_AHB + address), buffer, length, 0,
+                                    callback, callback_data);
+    return transfer->failure;
 }
 #endif
 
@@ -370,3 +1394,275 @@ DmacDescriptor* dma_descriptor(uint8_t channel_number) {
 DmacDescriptor* dma_write_back_descriptor(uint8_t channel_number) {
     return &write_back_descriptors[channel_number];
 }
+
+static bool sercom_dma_session_start(sercom_dma_session_t* session) {
+    uint8_t slot = session->current;
+    DmacDescriptor* tail = NULL;
+    dma_free_descriptor_chain(session->channel);
+    if (!dma_chain_append(session->channel, &tail, DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_SRCINC,
+                          (uint32_t) session->buffers[slot], (uint32_t) &session->sercom->SPI.DATA.reg,
+                          session->lengths[slot])) {
+        return false;
+    }
+    // The channel disabled itself at the end of the last write but kept its trigger settings.
+    dma_enable_channel(session->channel);
+    session->started = true;
+    return true;
+}
+
+static void sercom_dma_session_interrupt(uint8_t channel, uint8_t flags, void* data) {
+    sercom_dma_session_t* session = (sercom_dma_session_t*) data;
+    if ((flags & DMAC_CHINTFLAG_TERR) != 0) {
+        session->failure = DMA_FAILURE_INCOMPLETE;
+        session->queued = 0;
+        session->running = false;
+        return;
+    }
+    session->current = (session->current + 1) % SERCOM_DMA_SESSION_QUEUE_LENGTH;
+    session->queued--;
+    if (session->queued == 0) {
+        session->running = false;
+    } else if (!sercom_dma_session_start(session)) {
+        session->failure = DMA_FAILURE_NO_DESCRIPTOR_AVAILABLE;
+        session->queued = 0;
+        session->running = false;
+    }
+}
+
+int32_t sercom_dma_session_open(sercom_dma_session_t* session, Sercom* sercom) {
+    session->sercom = sercom;
+    session->current = 0;
+    session->queued = 0;
+    session->running = false;
+    session->started = false;
+    session->failure = 0;
+    session->channel = dma_allocate_non_audio_channel();
+    if (session->channel == NO_DMA_CHANNEL) {
+        return DMA_FAILURE_NO_CHANNEL_AVAILABLE;
+    }
+    dma_configure(session->channel, sercom_index(sercom) * 2 + FIRST_SERCOM_TX_TRIGSRC, false);
+    dma_set_channel_callback(session->channel, DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR,
+                             sercom_dma_session_interrupt, session);
+    return 0;
+}
+
+int32_t sercom_dma_session_write(sercom_dma_session_t* session, const uint8_t* buffer, uint32_t length) {
+    if (session->failure != 0) {
+        return session->failure;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    while (session->queued == SERCOM_DMA_SESSION_QUEUE_LENGTH) {}
+
+    mp_hal_disable_all_interrupts();
+    uint8_t slot = (session->current + session->queued) % SERCOM_DMA_SESSION_QUEUE_LENGTH;
+    session->buffers[slot] = buffer;
+    session->lengths[slot] = length;
+    session->queued++;
+    // The interrupt starts the next write when one is running. Otherwise start it here.
+    bool start = !session->running;
+    session->running = true;
+    mp_hal_enable_all_interrupts();
+
+    if (start && !sercom_dma_session_start(session)) {
+        session->queued = 0;
+        session->running = false;
+        return DMA_FAILURE_NO_DESCRIPTOR_AVAILABLE;
+    }
+    return 0;
+}
+
+int32_t sercom_dma_session_wait(sercom_dma_session_t* session) {
+    while (session->running) {}
+
+    int32_t failure = session->failure;
+    session->failure = 0;
+    // TXC never sets if nothing went out since the last wait.
+    if (!session->started) {
+        return failure;
+    }
+    session->started = false;
+
+    // Wait for the last byte to shift out and then throw away everything that came in like the
+    // write path of shared_dma_transfer_finished().
+    SercomSpi* spi = &session->sercom->SPI;
+    while (spi->INTFLAG.bit.TXC == 0) {}
+    while (spi->INTFLAG.bit.RXC == 1) {
+        spi->DATA.reg;
+    }
+    spi->STATUS.bit.BUFOVF = 1;
+    spi->INTFLAG.reg = SERCOM_SPI_INTFLAG_ERROR;
+    return failure;
+}
+
+void sercom_dma_session_close(sercom_dma_session_t* session) {
+    if (session->channel == NO_DMA_CHANNEL) {
+        return;
+    }
+    sercom_dma_session_wait(session);
+    dma_free_channel(session->channel);
+    session->channel = NO_DMA_CHANNEL;
+}
+
+int32_t dma_ring_init(dma_ring_t* ring, uint8_t channel_number, uint8_t trigsrc,
+                      void* buffer, uint32_t length, uint8_t block_count, uint16_t beat_size,
+                      volatile void* peripheral_register, bool to_peripheral,
+                      dma_ring_callback_t callback, void* callback_data) {
+    // Bytes of buffer per beat including any gap from STEPSIZE.
+    uint8_t beat_shift = ((beat_size & DMAC_BTCTRL_BEATSIZE_Msk) >> DMAC_BTCTRL_BEATSIZE_Pos) +
+                         ((beat_size & DMAC_BTCTRL_STEPSIZE_Msk) >> DMAC_BTCTRL_STEPSIZE_Pos);
+    uint32_t block_length = block_count > 0 ? length / block_count : 0;
+    if (block_length == 0 ||
+        block_length * block_count != length ||
+        (block_length & ((1 << beat_shift) - 1)) != 0 ||
+        (block_length >> beat_shift) > 0xffff) {
+        return DMA_FAILURE_INVALID_LENGTH;
+    }
+    ring->buffer = buffer;
+    ring->length = length;
+    ring->block_length = block_length;
+    ring->block_count = block_count;
+    ring->channel = channel_number;
+    ring->beat_shift = beat_shift;
+    ring->to_peripheral = to_peripheral;
+    ring->next_block = 0;
+    ring->failure = 0;
+    ring->blocks_done = 0;
+    ring->callback = callback;
+    ring->callback_data = callback_data;
+
+    dma_configure(channel_number, trigsrc, false);
+    dma_free_descriptor_chain(channel_number);
+
+    // Interrupt at the end of every block so we can report it.
+    uint16_t btctrl = beat_size | DMAC_BTCTRL_BLOCKACT_INT;
+    if (to_peripheral) {
+        // Step through memory, not the peripheral register.
+        btctrl |= DMAC_BTCTRL_STEPSEL;
+    }
+    DmacDescriptor* tail = NULL;
+    for (uint8_t i = 0; i < block_count; i++) {
+        uint32_t block = (uint32_t) ring->buffer + i * block_length;
+        bool ok;
+        if (to_peripheral) {
+            ok = dma_chain_append(channel_number, &tail, btctrl | DMAC_BTCTRL_SRCINC,
+                                  block, (uint32_t) peripheral_register, block_length >> beat_shift);
+        } else {
+            ok = dma_chain_append(channel_number, &tail, btctrl | DMAC_BTCTRL_DSTINC,
+                                  (uint32_t) peripheral_register, block, block_length >> beat_shift);
+        }
+        if (!ok) {
+            dma_free_descriptor_chain(channel_number);
+            return DMA_FAILURE_NO_DESCRIPTOR_AVAILABLE;
+        }
+    }
+    // Loop back to the start.
+    tail->DESCADDR.reg = (uint32_t) dma_descriptor(channel_number);
+    return 0;
+}
+
+// Returns false if the write back descriptor isn't in this ring yet.
+static bool dma_ring_read_position(dma_ring_t* ring, uint32_t* position) {
+    // The write back descriptor holds the end address of the current block and the beats left in
+    // it. Read the address twice so we don't mix up two different blocks.
+    DmacDescriptor* write_back = dma_write_back_descriptor(ring->channel);
+    volatile uint32_t* address = ring->to_peripheral ? &write_back->SRCADDR.reg : &write_back->DSTADDR.reg;
+    uint32_t block_end;
+    uint16_t beats_left;
+    do {
+        block_end = *address;
+        beats_left = write_back->BTCNT.reg;
+    } while (block_end != *address);
+
+    uint32_t start = (uint32_t) ring->buffer;
+    if (block_end <= start || block_end > start + ring->length) {
+        return false;
+    }
+    *position = block_end - start - (beats_left << ring->beat_shift);
+    if (*position >= ring->length) {
+        *position -= ring->length;
+    }
+    return true;
+}
+
+uint32_t dma_ring_position(dma_ring_t* ring) {
+    uint32_t position;
+    if (!dma_ring_read_position(ring, &position)) {
+        return 0;
+    }
+    return position;
+}
+
+static void dma_ring_interrupt(uint8_t channel, uint8_t flags, void* data) {
+    dma_ring_t* ring = (dma_ring_t*) data;
+    if ((flags & DMAC_CHINTFLAG_TERR) != 0) {
+        ring->failure = DMA_FAILURE_INCOMPLETE;
+        dma_ring_stop(ring);
+        return;
+    }
+    // TCMPL only tells us that at least one block finished. Use the position to catch up on any
+    // blocks we missed while interrupts were off.
+    uint32_t position;
+    uint8_t current_block = (ring->next_block + 1) % ring->block_count;
+    if (dma_ring_read_position(ring, &position)) {
+        current_block = position / ring->block_length;
+    }
+    do {
+        uint8_t block = ring->next_block;
+        ring->next_block = (block + 1) % ring->block_count;
+        ring->blocks_done++;
+        if (ring->callback != NULL) {
+            ring->callback(ring, block, ring->callback_data);
+        }
+    } while (ring->next_block != current_block);
+}
+
+void dma_ring_start(dma_ring_t* ring) {
+    ring->next_block = 0;
+    ring->failure = 0;
+    // Forget where the channel was last time so it doesn't look like we are part way through.
+    memset(dma_write_back_descriptor(ring->channel), 0, sizeof(DmacDescriptor));
+    dma_enable_channel(ring->channel);
+    // Without a callback there's nothing to do per block so only errors interrupt.
+    uint8_t interrupt_flags = DMAC_CHINTENSET_TERR;
+    if (ring->callback != NULL) {
+        interrupt_flags |= DMAC_CHINTENSET_TCMPL;
+    }
+    dma_set_channel_callback(ring->channel, interrupt_flags, dma_ring_interrupt, ring);
+}
+
+void dma_ring_stop(dma_ring_t* ring) {
+    dma_set_channel_callback(ring->channel, 0, NULL, NULL);
+    dma_disable_channel(ring->channel);
+}
+
+void dma_ring_deinit(dma_ring_t* ring) {
+    dma_ring_stop(ring);
+    dma_free_descriptor_chain(ring->channel);
+}
+
+#ifdef SAMD21
+void DMAC_Handler(void) {
+    dma_interrupt_handler();
+}
+#endif
+
+#ifdef SAM_D5X_E5X
+// Channels 0 - 3 have their own lines and the rest share DMAC_4.
+void DMAC_0_Handler(void) {
+    dma_interrupt_handler();
+}
+void DMAC_1_Handler(void) {
+    dma_interrupt_handler();
+}
+void DMAC_2_Handler(void) {
+    dma_interrupt_handler();
+}
+void DMAC_3_Handler(void) {
+    dma_interrupt_handler();
+}
+void DMAC_4_Handler(void) {
+    dma_interrupt_handler();
+}
+#endif
@@ -28,21 +28,48 @@
 #define MICROPY_INCLUDED_ATMEL_SAMD_PERIPHERALS_DMA_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "include/sam.h"
 
+#include "samd_peripherals_config.h"
+
 // We allocate DMA resources for the entire lifecycle of the board (not the
 // vm) because the general_dma resource will be shared between the REPL and SPI
 // flash. Both uses must block each other in order to prevent conflict.
+#ifndef AUDIO_DMA_CHANNEL_COUNT
 #define AUDIO_DMA_CHANNEL_COUNT 4
+#endif
 
 #ifdef SAMD21
 #define DMA_CHANNEL_COUNT 12
+#define DMA_ALL_CHANNELS_MASK ((1u << DMA_CHANNEL_COUNT) - 1)
 #endif
 
 #ifdef SAM_D5X_E5X
 #define DMA_CHANNEL_COUNT 32
+#define DMA_ALL_CHANNELS_MASK 0xffffffff
+#endif
+
+// Channels are allocated from pools given as a bit per channel. Audio channels come from
+// DMA_AUDIO_CHANNEL_MASK and everything else from the rest.
+#ifndef DMA_AUDIO_CHANNEL_MASK
+#define DMA_AUDIO_CHANNEL_MASK ((1u << AUDIO_DMA_CHANNEL_COUNT) - 1)
+#endif
+#define DMA_NON_AUDIO_CHANNEL_MASK (DMA_ALL_CHANNELS_MASK & ~(DMA_AUDIO_CHANNEL_MASK))
+
+// Channels are arbitrated by priority level first. Audio channels default to a higher level than
+// everything else so that large transfers don't starve them.
+#define DMA_PRIORITY_LEVEL_COUNT 4
+#ifndef DMA_AUDIO_PRIORITY_LEVEL
+#define DMA_AUDIO_PRIORITY_LEVEL 2
+#endif
+#define DMA_DEFAULT_PRIORITY_LEVEL 0
+
+// Descriptors shared by all channels for the second block onwards of a chain.
+#ifndef DMA_LINKED_DESCRIPTOR_COUNT
+#define DMA_LINKED_DESCRIPTOR_COUNT 16
 #endif
 
 // Returned when a channel can't be allocated.
@@ -52,7 +79,92 @@
 #define DMA_FAILURE_NO_CHANNEL_AVAILABLE (-1)
 #define DMA_FAILURE_INCOMPLETE (-2)
 #define DMA_FAILURE_ALIGNMENT (-3)
+#define DMA_FAILURE_NO_DESCRIPTOR_AVAILABLE (-4)
+#define DMA_FAILURE_LENGTH_MISMATCH (-5)
+#define DMA_FAILURE_INVALID_LENGTH (-6)
+#define DMA_FAILURE_TIMEOUT (-7)
+#define DMA_FAILURE_CRC_BUSY (-8)
+
+// Blocking transfers fail with DMA_FAILURE_TIMEOUT after this many polls without progress. Stuck
+// channels are restarted half way there.
+#ifndef DMA_WATCHDOG_STALL_POLLS
+#define DMA_WATCHDOG_STALL_POLLS 100000
+#endif
+
+typedef struct {
+    // Times the DMAC was found with pending channels but nothing active.
+    uint32_t hangs;
+    // Channels re-enabled to recover from a hang.
+    uint32_t channel_kicks;
+    // Blocking transfers given up on.
+    uint32_t timeouts;
+} dma_watchdog_stats_t;
+
+void dma_get_watchdog_stats(dma_watchdog_stats_t* stats);
+
+// Set DMA_STATISTICS to 1 to count transfers per channel, time them and keep a trace of recent
+// transfers. It's off by default because it adds work to every transfer.
+#ifndef DMA_STATISTICS
+#define DMA_STATISTICS 0
+#endif
+
+#if DMA_STATISTICS
+// Number of DMA_FAILURE_* values. Failure f is counted at index -f - 1.
+#define DMA_FAILURE_COUNT 8
+// Latency bucket n counts transfers that took from 2^(n - 1) up to 2^n - 1 CPU cycles.
+#define DMA_LATENCY_BUCKET_COUNT 32
+#ifndef DMA_TRACE_LENGTH
+#define DMA_TRACE_LENGTH 64
+#endif
+
+typedef struct {
+    uint32_t transfers;
+    uint32_t bytes;
+    uint32_t failures;
+} dma_channel_stats_t;
 
+typedef struct {
+    dma_channel_stats_t channels[DMA_CHANNEL_COUNT];
+    uint32_t failures[DMA_FAILURE_COUNT];
+    // Start to close of shared transfers. Only measured on SAMD51 which has a cycle counter.
+    uint32_t latency[DMA_LATENCY_BUCKET_COUNT];
+} dma_stats_t;
+
+typedef struct {
+    // Increases by one for every event. It's written last so a torn read can be detected.
+    volatile uint32_t sequence;
+    // CPU cycles on SAMD51 and 0 on SAMD21.
+    uint32_t timestamp;
+    void* peripheral;
+    uint32_t length;
+    uint8_t rx_channel;
+    uint8_t tx_channel;
+    // 0 when the channels were enabled, its length or DMA_FAILURE_* when it ended. Transfers that
+    // fail before they start only have the end event.
+    int32_t result;
+} dma_trace_event_t;
+
+const dma_stats_t* dma_get_stats(void);
+void dma_reset_stats(void);
+// Copy up to max_events trace events starting at *next_sequence, which is updated for the next
+// call. Start with 0. Events that were overwritten before they were read are skipped.
+size_t dma_read_trace(uint32_t* next_sequence, dma_trace_event_t* events, size_t max_events);
+#endif
+
+// CRC types for the DMAC CRC engine. There is one engine so only one transfer at a time can use
+// it. Others fail with DMA_FAILURE_CRC_BUSY.
+#define DMA_CRC_NONE 0
+#define DMA_CRC_16_CCITT 1
+#define DMA_CRC_32 2
+
+// One buffer of a scatter-gather list. length is in bytes. For SERCOM transfers a NULL buffer
+// sends the tx byte when writing and throws the bytes away when reading.
+typedef struct {
+    void* buffer;
+    uint32_t length;
+} dma_iovec_t;
+
+uint8_t dma_allocate_channel(uint32_t pool_mask);
 uint8_t dma_allocate_audio_channel(void);
 uint8_t dma_allocate_non_audio_channel(void);
 void dma_free_channel(uint8_t channel);
@@ -69,8 +181,44 @@ uint8_t sercom_index(Sercom* sercom);
 int32_t sercom_dma_write(Sercom* sercom, const uint8_t* buffer, uint32_t length);
 int32_t sercom_dma_read(Sercom* sercom, uint8_t* buffer, uint32_t length, uint8_t tx);
 int32_t sercom_dma_transfer(Sercom* sercom, const uint8_t* buffer_out, uint8_t* buffer_in, uint32_t length);
+// Send command_length command bytes and then clock in response_length bytes while sending fill, as
+// one DMA job with nothing for the CPU to do between the two phases. Returns the total length.
+int32_t sercom_dma_command(Sercom* sercom, const uint8_t* command, uint32_t command_length,
+                           uint8_t* response, uint32_t response_length, uint8_t fill);
 
-typedef struct {
+// Same as the calls above but the DMAC also computes a CRC of the data as it moves. Reads check
+// the data that came in and writes the data that went out.
+int32_t sercom_dma_write_crc(Sercom* sercom, const uint8_t* buffer, uint32_t length, uint8_t crc_type, uint32_t* crc);
+int32_t sercom_dma_read_crc(Sercom* sercom, uint8_t* buffer, uint32_t length, uint8_t tx, uint8_t crc_type, uint32_t* crc);
+#ifdef SAM_D5X_E5X
+int32_t qspi_dma_write_crc(uint32_t address, const uint8_t* buffer, uint32_t length, uint8_t crc_type, uint32_t* crc);
+int32_t qspi_dma_read_crc(uint32_t address, uint8_t* buffer, uint32_t length, uint8_t crc_type, uint32_t* crc);
+#endif
+// CRC a buffer in memory with a software triggered channel. Returns the length or a failure.
+int32_t dma_crc(const void* buffer, uint32_t length, uint8_t crc_type, uint32_t* crc);
+
+// Scatter-gather versions. Every buffer in the list goes out in one pass without the CPU.
+int32_t sercom_dma_write_iovec(Sercom* sercom, const dma_iovec_t* iov, size_t iov_count);
+int32_t sercom_dma_read_iovec(Sercom* sercom, const dma_iovec_t* iov, size_t iov_count, uint8_t tx);
+#ifdef SAM_D5X_E5X
+// Switch the SERCOM to 32-bit data for the word aligned middle of the buffer so the DMA moves
+// a quarter as many beats. The CPU moves the unaligned head and tail bytes. Short or mismatched
+// buffers use byte beats instead. The SERCOM is left in 8-bit mode.
+int32_t sercom_dma_write_32(Sercom* sercom, const uint8_t* buffer, uint32_t length);
+int32_t sercom_dma_read_32(Sercom* sercom, uint8_t* buffer, uint32_t length, uint8_t tx);
+int32_t sercom_dma_transfer_32(Sercom* sercom, const uint8_t* buffer_out, uint8_t* buffer_in, uint32_t length);
+
+int32_t qspi_dma_write_iovec(uint32_t address, const dma_iovec_t* iov, size_t iov_count);
+int32_t qspi_dma_read_iovec(uint32_t address, const dma_iovec_t* iov, size_t iov_count);
+#endif
+
+struct _dma_transfer_t;
+
+// Called from the DMAC interrupt once an async transfer is done and its channels are freed. result
+// is what shared_dma_transfer_close() returned: the length on success or a DMA_FAILURE_* value.
+typedef void (*dma_transfer_callback_t)(struct _dma_transfer_t* transfer, int32_t result, void* data);
+
+typedef struct _dma_transfer_t {
     void* peripheral;
     uint32_t length;
     uint8_t progress;
@@ -80,13 +228,111 @@ typedef struct {
     bool tx_active;
     bool sercom;
     int8_t failure;
+    // Repeated byte for reads copied into every byte so it works for byte and word beats. It
+    // lives here because the DMA reads it after start returns.
+    uint32_t tx_fill;
+    // Where reads into NULL scatter-gather buffers go.
+    uint32_t rx_discard;
+    // DMA_CRC_* type when the transfer holds the CRC engine and the checksum once it's closed.
+    uint8_t crc_type;
+    uint32_t crc;
+    // Channel interrupt flags seen by the DMAC interrupt. The interrupt clears them in hardware.
+    uint8_t rx_status;
+    uint8_t tx_status;
+    volatile bool complete;
+    dma_transfer_callback_t callback;
+    void* callback_data;
+    #if DMA_STATISTICS
+    uint32_t start_time;
+    #endif
 } dma_transfer_t;
 
 void shared_dma_transfer_start(dma_transfer_t* transfer, void* peripheral, const uint8_t* buffer_out, volatile uint32_t* dest, volatile uint32_t* src, uint8_t* buffer_in,  uint32_t length, uint8_t tx);
+void shared_dma_transfer_start_async(dma_transfer_t* transfer, void* peripheral, const uint8_t* buffer_out, volatile uint32_t* dest, volatile uint32_t* src, uint8_t* buffer_in,  uint32_t length, uint8_t tx,
+                                     dma_transfer_callback_t callback, void* callback_data);
+void shared_dma_transfer_start_iovec(dma_transfer_t* transfer, void* peripheral,
+                                     const dma_iovec_t* iov_out, size_t iov_out_count, volatile uint32_t* dest,
+                                     volatile uint32_t* src, const dma_iovec_t* iov_in, size_t iov_in_count, uint8_t tx);
+void shared_dma_transfer_start_iovec_async(dma_transfer_t* transfer, void* peripheral,
+                                           const dma_iovec_t* iov_out, size_t iov_out_count, volatile uint32_t* dest,
+                                           volatile uint32_t* src, const dma_iovec_t* iov_in, size_t iov_in_count, uint8_t tx,
+                                           dma_transfer_callback_t callback, void* callback_data);
 bool shared_dma_transfer_finished(dma_transfer_t* transfer);
 int shared_dma_transfer_close(dma_transfer_t* transfer);
 
+// Async versions of the calls above. They return 0 once the transfer is running or a
+// DMA_FAILURE_* value if it couldn't be started. The transfer must stay valid until callback
+// has been called or transfer->complete is true.
+int32_t sercom_dma_write_async(dma_transfer_t* transfer, Sercom* sercom, const uint8_t* buffer, uint32_t length,
+                               dma_transfer_callback_t callback, void* callback_data);
+int32_t sercom_dma_read_async(dma_transfer_t* transfer, Sercom* sercom, uint8_t* buffer, uint32_t length, uint8_t tx,
+                              dma_transfer_callback_t callback, void* callback_data);
+int32_t sercom_dma_transfer_async(dma_transfer_t* transfer, Sercom* sercom, const uint8_t* buffer_out, uint8_t* buffer_in, uint32_t length,
+                                  dma_transfer_callback_t callback, void* callback_data);
+int32_t sercom_dma_command_async(dma_transfer_t* transfer, Sercom* sercom, const uint8_t* command, uint32_t command_length,
+                                 uint8_t* response, uint32_t response_length, uint8_t fill,
+                                 dma_transfer_callback_t callback, void* callback_data);
+
+// Copy or fill memory with a software triggered channel so the CPU is free while it runs. Words or
+// halfwords are moved when dest, src and length allow it. Jobs shorter than DMA_MEMORY_MIN_LENGTH,
+// or started when no channel is free, are done by the CPU and callback is called before returning.
+#ifndef DMA_MEMORY_MIN_LENGTH
+#define DMA_MEMORY_MIN_LENGTH 64
+#endif
+int32_t dma_memcpy_async(dma_transfer_t* transfer, void* dest, const void* src, uint32_t length,
+                         dma_transfer_callback_t callback, void* callback_data);
+int32_t dma_memset_async(dma_transfer_t* transfer, void* dest, uint8_t value, uint32_t length,
+                         dma_transfer_callback_t callback, void* callback_data);
+
+#ifdef SAM_D5X_E5X
+int32_t qspi_dma_write_async(dma_transfer_t* transfer, uint32_t address, const uint8_t* buffer, uint32_t length,
+                             dma_transfer_callback_t callback, void* callback_data);
+int32_t qspi_dma_read_async(dma_transfer_t* transfer, uint32_t address, uint8_t* buffer, uint32_t length,
+                            dma_transfer_callback_t callback, void* callback_data);
+#endif
+
+// Called from the DMAC interrupt with the channel interrupt flags (DMAC_CHINTFLAG_*) that fired.
+// The flags have already been cleared.
+typedef void (*dma_channel_callback_t)(uint8_t channel, uint8_t flags, void* data);
+
+// Route the given DMAC_CHINTENSET_* interrupts of a channel to callback. A NULL callback turns
+// the channel's interrupts off. Freeing the channel also clears its callback.
+void dma_set_channel_callback(uint8_t channel_number, uint8_t interrupt_flags, dma_channel_callback_t callback, void* data);
+void dma_interrupt_handler(void);
+
 void dma_configure(uint8_t channel_number, uint8_t trigsrc, bool output_event);
+// What a channel does when its event input fires. The values match CHCTRLB.EVACT on the SAMD21
+// and CHEVCTRL.EVACT on the SAMD51.
+#define DMA_EVENT_ACTION_TRIGGER 1
+#define DMA_EVENT_ACTION_CONDITIONAL_TRIGGER 2
+#define DMA_EVENT_ACTION_CONDITIONAL_BLOCK 3
+#define DMA_EVENT_ACTION_SUSPEND 4
+#define DMA_EVENT_ACTION_RESUME 5
+#define DMA_EVENT_ACTION_SKIP_NEXT_BLOCK_SUSPEND 6
+
+// Only the low channels have event inputs. Get one with dma_allocate_channel() and this mask.
+#ifdef SAMD21
+#define DMA_EVENT_INPUT_CHANNEL_MASK 0x0000000f
+#endif
+#ifdef SAM_D5X_E5X
+#define DMA_EVENT_INPUT_CHANNEL_MASK 0x000000ff
+#endif
+
+// Enable the event input of a channel set up by dma_configure(), which clears it again. With
+// DMA_EVENT_ACTION_TRIGGER and no trigsrc each event moves one beat, or a whole block when
+// block_per_event is true. The channel must be disabled.
+void dma_configure_event_input(uint8_t channel_number, uint8_t event_action, bool block_per_event);
+// Does the above and makes the channel a user of event_channel. Returns false if the channel
+// has no event input.
+bool dma_connect_event_input(uint8_t channel_number, uint8_t event_channel, uint8_t event_action, bool block_per_event);
+
+// Configure a channel without a peripheral trigger. One software trigger moves the whole chain.
+void dma_configure_software(uint8_t channel_number);
+// Levels go from 0 to DMA_PRIORITY_LEVEL_COUNT - 1 and anything higher is ignored. The level is kept
+// across dma_configure() and reset to the pool default when the channel is freed.
+void dma_set_channel_priority(uint8_t channel_number, uint8_t level);
+// Round robin shares a level between its channels. Static always favors the lowest channel.
+void dma_set_priority_arbitration(uint8_t level, bool round_robin);
 void dma_enable_channel(uint8_t channel_number);
 void dma_disable_channel(uint8_t channel_number);
 void dma_suspend_channel(uint8_t channel_number);
@@ -94,7 +340,99 @@ void dma_resume_channel(uint8_t channel_number);
 bool dma_channel_free(uint8_t channel_number);
 bool dma_channel_enabled(uint8_t channel_number);
 uint8_t dma_transfer_status(uint8_t channel_number);
+void dma_enable_channel_interrupts(uint8_t channel_number, uint8_t interrupt_flags);
+void dma_disable_channel_interrupts(uint8_t channel_number);
+void dma_clear_channel_interrupts(uint8_t channel_number, uint8_t interrupt_flags);
 DmacDescriptor* dma_descriptor(uint8_t channel_number);
 DmacDescriptor* dma_write_back_descriptor(uint8_t channel_number);
 
+// Linked descriptors. dma_chain_append() adds beats to the end of a channel's chain starting
+// with dma_descriptor(channel_number) when *tail is NULL. It splits blocks that don't fit in
+// BTCNT and returns false if it runs out of descriptors. src and dst are start addresses.
+// Starting a chain clears the channel's first descriptor, so *tail stays NULL and the descriptor
+// stays invalid when there are no beats. Freeing a channel frees its chain.
+DmacDescriptor* dma_allocate_descriptor(void);
+void dma_free_descriptor(DmacDescriptor* descriptor);
+void dma_free_descriptor_chain(uint8_t channel_number);
+bool dma_chain_append(uint8_t channel_number, DmacDescriptor** tail, uint16_t btctrl, uint32_t src, uint32_t dst, uint32_t beats);
+
+// A SERCOM write channel that stays allocated and configured between writes. Queued writes are
+// started from the DMAC interrupt as soon as the previous one finishes so the bus stays busy
+// while the CPU prepares the next buffer. Buffers must stay valid until they are done.
+#ifndef SERCOM_DMA_SESSION_QUEUE_LENGTH
+#define SERCOM_DMA_SESSION_QUEUE_LENGTH 4
+#endif
+
+typedef struct {
+    Sercom* sercom;
+    const uint8_t* buffers[SERCOM_DMA_SESSION_QUEUE_LENGTH];
+    uint32_t lengths[SERCOM_DMA_SESSION_QUEUE_LENGTH];
+    uint8_t channel;
+    // Index of the running write and the number of writes including it.
+    volatile uint8_t current;
+    volatile uint8_t queued;
+    volatile bool running;
+    // Whether any write has gone to the DMAC since the last wait.
+    volatile bool started;
+    volatile int8_t failure;
+} sercom_dma_session_t;
+
+int32_t sercom_dma_session_open(sercom_dma_session_t* session, Sercom* sercom);
+// Queue a write. Blocks while the queue is full.
+int32_t sercom_dma_session_write(sercom_dma_session_t* session, const uint8_t* buffer, uint32_t length);
+// Wait for all queued writes to go out. Returns 0 or the first failure since the last wait.
+int32_t sercom_dma_session_wait(sercom_dma_session_t* session);
+void sercom_dma_session_close(sercom_dma_session_t* session);
+
+struct _dma_ring_t;
+
+// Called from the DMAC interrupt for every block the DMA has finished with. For a ring into
+// memory the block is full of new data and for a ring out of memory it can be refilled.
+typedef void (*dma_ring_callback_t)(struct _dma_ring_t* ring, uint8_t block, void* data);
+
+// A buffer split into blocks that a channel moves over and over with one descriptor per block.
+// Two blocks gives half and full buffer callbacks.
+typedef struct _dma_ring_t {
+    uint8_t* buffer;
+    uint32_t length;
+    uint32_t block_length;
+    uint8_t block_count;
+    uint8_t channel;
+    uint8_t beat_shift;
+    bool to_peripheral;
+    // The next block to report as done.
+    uint8_t next_block;
+    int8_t failure;
+    volatile uint32_t blocks_done;
+    dma_ring_callback_t callback;
+    void* callback_data;
+} dma_ring_t;
+
+// The channel must already be allocated. buffer is split into block_count equal blocks that must
+// each be a whole number of beats and at most 65535 beats long. beat_size is a
+// DMAC_BTCTRL_BEATSIZE_* value. Adding DMAC_BTCTRL_STEPSIZE(n) leaves room for 2^n - 1 beats
+// between the ones this ring moves so two rings can interleave in one buffer. callback may be NULL.
+// The ring then only interrupts on errors and blocks_done stays 0.
+int32_t dma_ring_init(dma_ring_t* ring, uint8_t channel_number, uint8_t trigsrc,
+                      void* buffer, uint32_t length, uint8_t block_count, uint16_t beat_size,
+                      volatile void* peripheral_register, bool to_peripheral,
+                      dma_ring_callback_t callback, void* callback_data);
+void dma_ring_start(dma_ring_t* ring);
+void dma_ring_stop(dma_ring_t* ring);
+void dma_ring_deinit(dma_ring_t* ring);
+// Byte offset into the buffer that the DMA will move next. Safe to call from anywhere.
+uint32_t dma_ring_position(dma_ring_t* ring);
+
+// Handlers
+#ifdef SAMD21
+void DMAC_Handler(void);
+#endif
+#ifdef SAM_D5X_E5X
+void DMAC_0_Handler(void);
+void DMAC_1_Handler(void);
+void DMAC_2_Handler(void);
+void DMAC_3_Handler(void);
+void DMAC_4_Handler(void);
+#endif
+
 #endif  // MICROPY_INCLUDED_ATMEL_SAMD_PERIPHERALS_DMA_H
@@ -41,6 +41,456 @@ void i2s_set_enable(bool enable) {
 
 void i2s_set_clock_unit_enable(uint8_t clock_unit, bool enable) {
     while ((I2S->SYNCBUSY.vec.CKEN & (1 << clock_unit)) != 0) {}
-    I2S->CTRLA.vec.CKEN = 1 << clock_unit;
+    if (enable) {
+        I2S->CTRLA.vec.CKEN |= 1 << clock_unit;
+    } else {
+        I2S->CTRLA.vec.CKEN &= ~(1 << clock_unit);
+    }
     while ((I2S->SYNCBUSY.vec.CKEN & (1 << clock_unit)) != 0) {}
 }
+
+#ifdef SAMD21
+// clock_get_frequency() assumes the DPLL runs at 96mhz so it is only used through planned DPLL settings.
+static const uint8_t clock_sources[] = {GCLK_GENCTRL_SRC_DFLL48M_Val, GCLK_GENCTRL_SRC_OSC8M_Val};
+#endif
+#ifdef SAM_D5X_E5X
+// DPLL1 is only used through planned DPLL settings because the stream that started it stops it.
+static const uint8_t clock_sources[] = {GCLK_GENCTRL_SRC_DFLL_Val, GCLK_GENCTRL_SRC_DPLL0_Val};
+#endif
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Look for a DPLL output that is a whole multiple of sck_frequency and also a whole multiple of
+// the 48mhz clock divided down to a reference the DPLL accepts.
+static bool i2s_plan_dpll(uint32_t sck_frequency, uint8_t dpll, i2s_clock_plan_t* plan) {
+    for (uint32_t r = 1; r <= 0xff; r++) {
+        uint32_t reference = 48000000 / r;
+        if (reference > CLOCK_DPLL_MAX_REFERENCE) {
+            continue;
+        }
+        if (reference < CLOCK_DPLL_MIN_REFERENCE) {
+            break;
+        }
+        // The total division k works when sck_frequency * k * r is a multiple of 48mhz.
+        uint32_t k_step = 48000000 / gcd(48000000, ((uint64_t) sck_frequency * r) % 48000000);
+        uint32_t k = (CLOCK_DPLL_MIN_FREQUENCY + sck_frequency - 1) / sck_frequency;
+        k = (k + k_step - 1) / k_step * k_step;
+        for (; (uint64_t) sck_frequency * k <= CLOCK_DPLL_MAX_FREQUENCY; k += k_step) {
+            uint64_t multiplier = (uint64_t) sck_frequency * k * r / 48000000;
+            if (multiplier > CLOCK_DPLL_MAX_MULTIPLIER) {
+                break;
+            }
+            // Divide as much as possible in the GCLK to keep its output slow.
+            for (uint8_t m = 1; m <= I2S_MCKDIV_MAX; m++) {
+                if (k % m != 0 || k / m > 0xff) {
+                    continue;
+                }
+                plan->sck_frequency = sck_frequency;
+                plan->error_ppm = 0;
+                plan->gclk_divisor = k / m;
+                plan->mckdiv = m;
+                plan->source = dpll;
+                plan->dpll_multiplier = multiplier;
+                plan->dpll_reference_divisor = r;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool i2s_plan_clock(uint32_t sck_frequency, i2s_clock_plan_t* plan) {
+    if (sck_frequency == 0) {
+        return false;
+    }
+    uint32_t best_error = 0xffffffff;
+    for (uint8_t i = 0; i < sizeof(clock_sources); i++) {
+        uint8_t source = clock_sources[i];
+        if (!clock_get_enabled(0, source)) {
+            continue;
+        }
+        uint32_t frequency = clock_get_frequency(0, source);
+        for (uint8_t m = 1; m <= I2S_MCKDIV_MAX && frequency != 0; m++) {
+            uint64_t step = (uint64_t) sck_frequency * m;
+            uint32_t divisor = (frequency + step / 2) / step;
+            // Leave the generators with 16-bit dividers for those that need them.
+            if (divisor == 0 || divisor > 0xff) {
+                continue;
+            }
+            int32_t error = (int64_t) frequency * 1000000 / (step * divisor) - 1000000;
+            uint32_t magnitude = error < 0 ? -error : error;
+            if (magnitude < best_error) {
+                best_error = magnitude;
+                plan->sck_frequency = frequency / (divisor * m);
+                plan->error_ppm = error;
+                plan->gclk_divisor = divisor;
+                plan->mckdiv = m;
+                plan->source = source;
+                plan->dpll_multiplier = 0;
+                plan->dpll_reference_divisor = 0;
+            }
+        }
+    }
+    if (best_error != 0) {
+        uint8_t dpll = find_free_dpll();
+        if (dpll != 0xff && i2s_plan_dpll(sck_frequency, dpll, plan)) {
+            best_error = 0;
+        }
+    }
+    return best_error != 0xffffffff;
+}
+
+static void i2s_stream_release_clock(i2s_stream_t* stream) {
+    if (stream->gclk != 0xff) {
+        disconnect_gclk_from_peripheral(stream->gclk, I2S_GCLK_ID_0 + stream->clock_unit);
+        disable_clock_generator(stream->gclk);
+        stream->gclk = 0xff;
+    }
+    if (stream->dpll != 0xff) {
+        disable_dpll(stream->dpll);
+        disable_clock_generator(stream->dpll_reference_gclk);
+        stream->dpll = 0xff;
+    }
+}
+
+static bool i2s_stream_claim_clock(i2s_stream_t* stream, const i2s_clock_plan_t* plan) {
+    stream->gclk = 0xff;
+    stream->dpll = 0xff;
+    if (plan->dpll_multiplier != 0) {
+        stream->dpll_reference_gclk = find_free_gclk(plan->dpll_reference_divisor);
+        if (stream->dpll_reference_gclk == 0xff) {
+            return false;
+        }
+        enable_clock_generator(stream->dpll_reference_gclk, CLOCK_48MHZ, plan->dpll_reference_divisor);
+        stream->dpll = plan->source;
+        enable_dpll(stream->dpll, stream->dpll_reference_gclk, plan->dpll_multiplier);
+    }
+    uint8_t gclk = find_free_gclk(plan->gclk_divisor);
+    if (gclk == 0xff) {
+        i2s_stream_release_clock(stream);
+        return false;
+    }
+    enable_clock_generator(gclk, plan->source, plan->gclk_divisor);
+    connect_gclk_to_peripheral(gclk, I2S_GCLK_ID_0 + stream->clock_unit);
+    stream->gclk = gclk;
+    return true;
+}
+
+// Register and DMA settings for a sample format. Stereo 8 and 16 bit samples use the compact
+// sizes so one beat carries a whole frame.
+static bool i2s_format_settings(const i2s_format_t* format, uint8_t* datasize, uint16_t* beat_size,
+                                uint32_t* slot_size) {
+    bool mono = format->channel_count == 1;
+    if ((!mono && format->channel_count != 2) || format->sample_rate == 0) {
+        return false;
+    }
+    switch (format->bits_per_sample) {
+        case 8:
+            *datasize = mono ? I2S_DATASIZE_8 : I2S_DATASIZE_8C;
+            *beat_size = mono ? DMAC_BTCTRL_BEATSIZE_BYTE : DMAC_BTCTRL_BEATSIZE_HWORD;
+            *slot_size = I2S_CLKCTRL_SLOTSIZE_8;
+            return true;
+        case 16:
+            *datasize = mono ? I2S_DATASIZE_16 : I2S_DATASIZE_16C;
+            *beat_size = mono ? DMAC_BTCTRL_BEATSIZE_HWORD : DMAC_BTCTRL_BEATSIZE_WORD;
+            *slot_size = I2S_CLKCTRL_SLOTSIZE_16;
+            return true;
+        case 24:
+            *datasize = I2S_DATASIZE_24;
+            *beat_size = DMAC_BTCTRL_BEATSIZE_WORD;
+            *slot_size = I2S_CLKCTRL_SLOTSIZE_24;
+            return true;
+        case 32:
+            *datasize = I2S_DATASIZE_32;
+            *beat_size = DMAC_BTCTRL_BEATSIZE_WORD;
+            *slot_size = I2S_CLKCTRL_SLOTSIZE_32;
+            return true;
+    }
+    return false;
+}
+
+// Point a new DMA ring at the configured serializer. The clock is left alone.
+static int32_t i2s_stream_setup_ring(i2s_stream_t* stream, uint8_t serializer, bool tx, uint16_t beat_size,
+                                     void* buffer, uint32_t length, uint8_t block_count,
+                                     dma_ring_callback_t callback, void* callback_data) {
+    stream->serializer = serializer;
+    stream->tx = tx;
+    stream->dma_channel = dma_allocate_audio_channel();
+    if (stream->dma_channel == NO_DMA_CHANNEL) {
+        return DMA_FAILURE_NO_CHANNEL_AVAILABLE;
+    }
+    int32_t result = dma_ring_init(&stream->ring, stream->dma_channel,
+                                   i2s_serializer_dma_trigger(serializer, tx),
+                                   buffer, length, block_count, beat_size,
+                                   i2s_serializer_data_register(serializer, tx), tx,
+                                   callback, callback_data);
+    if (result != 0) {
+        dma_free_channel(stream->dma_channel);
+        stream->dma_channel = NO_DMA_CHANNEL;
+    }
+    return result;
+}
+
+// Plan and claim a clock for the stream's clock unit. framing holds the CLKCTRL slot and frame sync
+// settings.
+static int32_t i2s_stream_setup_clock(i2s_stream_t* stream, uint8_t clock_unit, uint32_t sck_frequency,
+                                      uint32_t frame_bits, uint32_t framing) {
+    i2s_clock_plan_t plan;
+    if (!i2s_plan_clock(sck_frequency, &plan)) {
+        return I2S_FAILURE_NO_CLOCK;
+    }
+    turn_on_i2s_clock_unit(clock_unit);
+    stream->clock_unit = clock_unit;
+    stream->sample_rate = plan.sck_frequency / frame_bits;
+    stream->rate_error_ppm = plan.error_ppm;
+    stream->dma_channel = NO_DMA_CHANNEL;
+    if (!i2s_stream_claim_clock(stream, &plan)) {
+        return I2S_FAILURE_NO_CLOCK;
+    }
+    // CLKCTRL can only change while the clock unit is off.
+    i2s_set_clock_unit_enable(clock_unit, false);
+    I2S->CLKCTRL[clock_unit].reg = I2S_CLKCTRL_MCKSEL_GCLK |
+                                   I2S_CLKCTRL_SCKSEL_MCKDIV |
+                                   I2S_CLKCTRL_FSSEL_SCKDIV |
+                                   I2S_CLKCTRL_MCKDIV(plan.mckdiv - 1) |
+                                   framing;
+    i2s_set_enable(true);
+    return 0;
+}
+
+int32_t i2s_stream_init(i2s_stream_t* stream, uint8_t clock_unit, uint8_t serializer, bool tx,
+                        const i2s_format_t* format, void* buffer, uint32_t length, uint8_t block_count,
+                        dma_ring_callback_t callback, void* callback_data) {
+    uint8_t datasize;
+    uint16_t beat_size;
+    uint32_t slot_size;
+    if (!i2s_format_settings(format, &datasize, &beat_size, &slot_size)) {
+        return I2S_FAILURE_INVALID_FORMAT;
+    }
+
+    // Two slots per frame even for mono.
+    uint32_t frame_bits = format->bits_per_sample * 2;
+    uint32_t framing = I2S_CLKCTRL_FSWIDTH_HALF | I2S_CLKCTRL_NBSLOTS(1) | slot_size;
+    if (!format->left_justified) {
+        framing |= I2S_CLKCTRL_BITDELAY_I2S;
+    }
+    int32_t result = i2s_stream_setup_clock(stream, clock_unit, format->sample_rate * frame_bits,
+                                            frame_bits, framing);
+    if (result != 0) {
+        return result;
+    }
+    if (!i2s_configure_serializer(serializer, clock_unit, tx, datasize, format->channel_count == 1)) {
+        i2s_stream_release_clock(stream);
+        return I2S_FAILURE_INVALID_SERIALIZER;
+    }
+    result = i2s_stream_setup_ring(stream, serializer, tx, beat_size, buffer, length, block_count,
+                                   callback, callback_data);
+    if (result != 0) {
+        i2s_stream_release_clock(stream);
+    }
+    return result;
+}
+
+int32_t i2s_pdm_init(i2s_stream_t* stream, uint8_t clock_unit, uint8_t serializer, uint32_t sample_rate,
+                     uint32_t* buffer, uint32_t word_count, uint8_t block_count,
+                     dma_ring_callback_t callback, void* callback_data) {
+    if (sample_rate == 0) {
+        return I2S_FAILURE_INVALID_FORMAT;
+    }
+    // Two 16-bit slots per frame. Each slot gives one word with a bit from each edge of SCK.
+    int32_t result = i2s_stream_setup_clock(stream, clock_unit, sample_rate * PDM_FILTER_OVERSAMPLING,
+                                            PDM_FILTER_OVERSAMPLING,
+                                            I2S_CLKCTRL_FSWIDTH_SLOT | I2S_CLKCTRL_BITDELAY_LJ |
+                                            I2S_CLKCTRL_NBSLOTS(1) | I2S_CLKCTRL_SLOTSIZE_16);
+    if (result != 0) {
+        return result;
+    }
+    if (!i2s_configure_pdm_serializer(serializer, clock_unit)) {
+        i2s_stream_release_clock(stream);
+        return I2S_FAILURE_INVALID_SERIALIZER;
+    }
+    result = i2s_stream_setup_ring(stream, serializer, false, DMAC_BTCTRL_BEATSIZE_WORD, buffer,
+                                   word_count * sizeof(uint32_t), block_count, callback, callback_data);
+    if (result != 0) {
+        i2s_stream_release_clock(stream);
+    }
+    return result;
+}
+
+void i2s_stream_start(i2s_stream_t* stream) {
+    // Start the DMA first so a transmitter has its first sample waiting.
+    dma_ring_start(&stream->ring);
+    i2s_set_clock_unit_enable(stream->clock_unit, true);
+    i2s_set_serializer_enable(stream->serializer, true);
+}
+
+void i2s_stream_stop(i2s_stream_t* stream) {
+    i2s_set_serializer_enable(stream->serializer, false);
+    i2s_set_clock_unit_enable(stream->clock_unit, false);
+    dma_ring_stop(&stream->ring);
+}
+
+void i2s_stream_deinit(i2s_stream_t* stream) {
+    if (stream->dma_channel == NO_DMA_CHANNEL) {
+        return;
+    }
+    i2s_stream_stop(stream);
+    dma_ring_deinit(&stream->ring);
+    dma_free_channel(stream->dma_channel);
+    stream->dma_channel = NO_DMA_CHANNEL;
+    i2s_stream_release_clock(stream);
+}
+
+int32_t i2s_tdm_init(i2s_stream_t* stream, uint8_t clock_unit, uint8_t serializer, bool tx,
+                     const i2s_tdm_format_t* format, void* buffer, uint32_t length, uint8_t block_count,
+                     dma_ring_callback_t callback, void* callback_data) {
+    if (format->slot_count < 2 || format->slot_count > 8) {
+        return I2S_FAILURE_INVALID_FORMAT;
+    }
+    // Every slot is its own beat, which matches the mono sizes because those aren't compact.
+    const i2s_format_t slot_format = {
+        .sample_rate = format->sample_rate,
+        .bits_per_sample = format->bits_per_sample,
+        .channel_count = 1,
+    };
+    uint8_t datasize;
+    uint16_t beat_size;
+    uint32_t slot_size;
+    if (!i2s_format_settings(&slot_format, &datasize, &beat_size, &slot_size)) {
+        return I2S_FAILURE_INVALID_FORMAT;
+    }
+
+    uint32_t frame_bits = format->bits_per_sample * format->slot_count;
+    uint32_t framing = I2S_CLKCTRL_NBSLOTS(format->slot_count - 1) | slot_size;
+    framing |= format->pulse_frame_sync ? I2S_CLKCTRL_FSWIDTH_BIT : I2S_CLKCTRL_FSWIDTH_HALF;
+    if (!format->left_justified) {
+        framing |= I2S_CLKCTRL_BITDELAY_I2S;
+    }
+    int32_t result = i2s_stream_setup_clock(stream, clock_unit, format->sample_rate * frame_bits,
+                                            frame_bits, framing);
+    if (result != 0) {
+        return result;
+    }
+    if (!i2s_configure_serializer(serializer, clock_unit, tx, datasize, false)) {
+        i2s_stream_release_clock(stream);
+        return I2S_FAILURE_INVALID_SERIALIZER;
+    }
+    result = i2s_stream_setup_ring(stream, serializer, tx, beat_size, buffer, length, block_count,
+                                   callback, callback_data);
+    if (result != 0) {
+        i2s_stream_release_clock(stream);
+    }
+    return result;
+}
+
+void i2s_tdm_deinterleave(const void* frames, uint32_t frame_count, uint8_t slot_count,
+                          uint8_t sample_size, void* const* channels) {
+    for (uint8_t slot = 0; slot < slot_count; slot++) {
+        if (sample_size == 1) {
+            const uint8_t* in = (const uint8_t*) frames + slot;
+            uint8_t* out = channels[slot];
+            for (uint32_t i = 0; i < frame_count; i++) {
+                out[i] = in[i * slot_count];
+            }
+        } else if (sample_size == 2) {
+            const uint16_t* in = (const uint16_t*) frames + slot;
+            uint16_t* out = channels[slot];
+            for (uint32_t i = 0; i < frame_count; i++) {
+                out[i] = in[i * slot_count];
+            }
+        } else {
+            const uint32_t* in = (const uint32_t*) frames + slot;
+            uint32_t* out = channels[slot];
+            for (uint32_t i = 0; i < frame_count; i++) {
+                out[i] = in[i * slot_count];
+            }
+        }
+    }
+}
+
+void i2s_tdm_interleave(const void* const* channels, uint32_t frame_count, uint8_t slot_count,
+                        uint8_t sample_size, void* frames) {
+    for (uint8_t slot = 0; slot < slot_count; slot++) {
+        if (sample_size == 1) {
+            const uint8_t* in = channels[slot];
+            uint8_t* out = (uint8_t*) frames + slot;
+            for (uint32_t i = 0; i < frame_count; i++) {
+                out[i * slot_count] = in[i];
+            }
+        } else if (sample_size == 2) {
+            const uint16_t* in = channels[slot];
+            uint16_t* out = (uint16_t*) frames + slot;
+            for (uint32_t i = 0; i < frame_count; i++) {
+                out[i * slot_count] = in[i];
+            }
+        } else {
+            const uint32_t* in = channels[slot];
+            uint32_t* out = (uint32_t*) frames + slot;
+            for (uint32_t i = 0; i < frame_count; i++) {
+                out[i * slot_count] = in[i];
+            }
+        }
+    }
+}
+
+int32_t i2s_duplex_init(i2s_duplex_t* duplex, uint8_t clock_unit, uint8_t tx_serializer,
+                        uint8_t rx_serializer, const i2s_format_t* format, void* tx_buffer,
+                        void* rx_buffer, uint32_t length, uint8_t block_count,
+                        dma_ring_callback_t callback, void* callback_data) {
+    if (tx_serializer == rx_serializer) {
+        return I2S_FAILURE_INVALID_SERIALIZER;
+    }
+    int32_t result = i2s_stream_init(&duplex->tx, clock_unit, tx_serializer, true, format,
+                                     tx_buffer, length, block_count, NULL, NULL);
+    if (result != 0) {
+        return result;
+    }
+    // The receiver shares the transmitter's clock unit so it doesn't own a clock of its own.
+    i2s_stream_t* rx = &duplex->rx;
+    rx->clock_unit = clock_unit;
+    rx->sample_rate = duplex->tx.sample_rate;
+    rx->rate_error_ppm = duplex->tx.rate_error_ppm;
+    rx->gclk = 0xff;
+    rx->dpll = 0xff;
+    rx->dma_channel = NO_DMA_CHANNEL;
+    uint8_t datasize;
+    uint16_t beat_size;
+    uint32_t slot_size;
+    i2s_format_settings(format, &datasize, &beat_size, &slot_size);
+    if (!i2s_configure_serializer(rx_serializer, clock_unit, false, datasize, format->channel_count == 1)) {
+        i2s_stream_deinit(&duplex->tx);
+        return I2S_FAILURE_INVALID_SERIALIZER;
+    }
+    result = i2s_stream_setup_ring(rx, rx_serializer, false, beat_size, rx_buffer, length,
+                                   block_count, callback, callback_data);
+    if (result != 0) {
+        i2s_stream_deinit(&duplex->tx);
+        return result;
+    }
+    return 0;
+}
+
+void i2s_duplex_start(i2s_duplex_t* duplex) {
+    dma_ring_start(&duplex->tx.ring);
+    dma_ring_start(&duplex->rx.ring);
+    // One write starts the clock and both serializers so they begin on the same frame.
+    i2s_set_duplex_enable(duplex->tx.clock_unit, duplex->tx.serializer, duplex->rx.serializer, true);
+}
+
+void i2s_duplex_stop(i2s_duplex_t* duplex) {
+    i2s_set_duplex_enable(duplex->tx.clock_unit, duplex->tx.serializer, duplex->rx.serializer, false);
+    dma_ring_stop(&duplex->rx.ring);
+    dma_ring_stop(&duplex->tx.ring);
+}
+
+void i2s_duplex_deinit(i2s_duplex_t* duplex) {
+    i2s_stream_deinit(&duplex->rx);
+    i2s_stream_deinit(&duplex->tx);
+}
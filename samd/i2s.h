@@ -32,10 +32,158 @@
 
 #include "include/sam.h"
 
+#include "samd/dma.h"
+#include "samd/pdm_filter.h"
+
 void turn_on_i2s(void);
+// Turn on the bus clock and reset only the given clock unit to the default clock so that a stream
+// running on the other clock unit keeps its clock.
+void turn_on_i2s_clock_unit(uint8_t clock_unit);
 
 void i2s_set_enable(bool enable);
 void i2s_set_clock_unit_enable(uint8_t clock, bool enable);
 void i2s_set_serializer_enable(uint8_t serializer, bool enable);
+// Turn a clock unit and two serializers on or off with a single write.
+void i2s_set_duplex_enable(uint8_t clock_unit, uint8_t tx_serializer, uint8_t rx_serializer, bool enable);
+
+// DATASIZE values. They are the same in SERCTRL, TXCTRL and RXCTRL.
+#define I2S_DATASIZE_32 0
+#define I2S_DATASIZE_24 1
+#define I2S_DATASIZE_16 4
+#define I2S_DATASIZE_16C 5
+#define I2S_DATASIZE_8 6
+#define I2S_DATASIZE_8C 7
+
+// Largest serial clock divisor from CLKCTRL.MCKDIV.
+#ifdef SAMD21
+#define I2S_MCKDIV_MAX 32
+#endif
+#ifdef SAM_D5X_E5X
+#define I2S_MCKDIV_MAX 64
+#endif
+
+// Set up a serializer to move samples in one direction with DMA, clocked by clock_unit. Mono
+// transmits each sample in both slots and only receives the left one. Returns false if the
+// serializer can't be used that way. The SAMD51 only transmits on serializer 0 from clock unit 0
+// and only receives on serializer 1.
+bool i2s_configure_serializer(uint8_t serializer, uint8_t clock_unit, bool tx, uint8_t datasize, bool mono);
+// Set up a serializer to receive two PDM microphones, one on each edge of SCK. The SAMD51 only
+// receives on serializer 1.
+bool i2s_configure_pdm_serializer(uint8_t serializer, uint8_t clock_unit);
+volatile uint32_t* i2s_serializer_data_register(uint8_t serializer, bool tx);
+uint8_t i2s_serializer_dma_trigger(uint8_t serializer, bool tx);
+
+// How to get a serial clock: a GCLK from source divided by gclk_divisor feeds the clock unit,
+// which divides it again by mckdiv. When dpll_multiplier is set, source is a free DPLL that has to
+// be started from the 48mhz clock divided by dpll_reference_divisor.
+typedef struct {
+    uint32_t sck_frequency;
+    int32_t error_ppm;
+    uint16_t gclk_divisor;
+    uint16_t dpll_multiplier;
+    uint8_t dpll_reference_divisor;
+    uint8_t source;
+    uint8_t mckdiv;
+} i2s_clock_plan_t;
+
+// Plan the closest serial clock to sck_frequency from the sources that are running. If that isn't
+// exact and a DPLL is free, look for a DPLL setting that is exact relative to the 48mhz clock.
+// Returns false if nothing comes within reach.
+bool i2s_plan_clock(uint32_t sck_frequency, i2s_clock_plan_t* plan);
+
+#define I2S_FAILURE_INVALID_FORMAT (-32)
+#define I2S_FAILURE_INVALID_SERIALIZER (-33)
+#define I2S_FAILURE_NO_CLOCK (-34)
+
+typedef struct {
+    uint32_t sample_rate;
+    // 8, 16, 24 or 32. 24-bit samples are the low three bytes of each uint32_t.
+    uint8_t bits_per_sample;
+    // 1 or 2. Stereo samples are interleaved left first.
+    uint8_t channel_count;
+    // Frame sync changes with the first bit of the left sample instead of one bit before it.
+    bool left_justified;
+} i2s_format_t;
+
+// One serializer playing from or capturing into a DMA ring. The clock unit gets its own GCLK, and
+// its own DPLL when that is what gives an exact rate. The stream holds them until deinit so the
+// rate can't drift out from under it. The SCK, FS and SD pins must already be muxed to the I2S.
+typedef struct {
+    dma_ring_t ring;
+    // The rate the clocks actually give, which may be a little off the requested one.
+    uint32_t sample_rate;
+    int32_t rate_error_ppm;
+    uint8_t clock_unit;
+    uint8_t serializer;
+    uint8_t gclk;
+    // 0xff when the stream runs from a clock that was already running.
+    uint8_t dpll;
+    uint8_t dpll_reference_gclk;
+    uint8_t dma_channel;
+    bool tx;
+} i2s_stream_t;
+
+// Returns 0, an I2S_FAILURE_* or a DMA_FAILURE_* value. buffer holds length bytes of samples split
+// into block_count blocks. Two blocks gives half and full buffer callbacks, which come from the
+// DMAC interrupt as each block is played or filled.
+int32_t i2s_stream_init(i2s_stream_t* stream, uint8_t clock_unit, uint8_t serializer, bool tx,
+                        const i2s_format_t* format, void* buffer, uint32_t length, uint8_t block_count,
+                        dma_ring_callback_t callback, void* callback_data);
+void i2s_stream_start(i2s_stream_t* stream);
+void i2s_stream_stop(i2s_stream_t* stream);
+void i2s_stream_deinit(i2s_stream_t* stream);
+
+// Capture the raw bitstream of one or two PDM microphones into a ring of words. SCK runs at
+// PDM_FILTER_OVERSAMPLING times sample_rate and each word holds 16 bits from each microphone, so
+// every four words are one sample. Feed the blocks to pdm_filter_run() for PCM. The stream's
+// sample_rate is the PCM rate. Start, stop and deinit it like any other stream.
+int32_t i2s_pdm_init(i2s_stream_t* stream, uint8_t clock_unit, uint8_t serializer, uint32_t sample_rate,
+                     uint32_t* buffer, uint32_t word_count, uint8_t block_count,
+                     dma_ring_callback_t callback, void* callback_data);
+
+// Time division multiplexed frames of up to eight slots, as used by multichannel codecs and DAC
+// arrays. One serializer carries every channel.
+typedef struct {
+    uint32_t sample_rate;
+    // 8, 16, 24 or 32. This is also the slot size. Samples take a byte, a halfword or a word in
+    // memory, with 24-bit samples in the low three bytes of a word.
+    uint8_t bits_per_sample;
+    // 2 to 8 slots per frame, usually 4 or 8.
+    uint8_t slot_count;
+    // Frame sync is a single SCK wide pulse instead of high for the first half of the frame.
+    bool pulse_frame_sync;
+    // Frame sync changes with the first bit of slot 0 instead of one bit before it.
+    bool left_justified;
+} i2s_tdm_format_t;
+
+// The ring holds whole frames of slot_count interleaved samples, slot 0 first. Each block should
+// hold whole frames.
+int32_t i2s_tdm_init(i2s_stream_t* stream, uint8_t clock_unit, uint8_t serializer, bool tx,
+                     const i2s_tdm_format_t* format, void* buffer, uint32_t length, uint8_t block_count,
+                     dma_ring_callback_t callback, void* callback_data);
+
+// Split frame_count interleaved frames into one buffer per slot, or join them back for playback.
+// sample_size is the size of each sample in memory: 1, 2 or 4 bytes.
+void i2s_tdm_deinterleave(const void* frames, uint32_t frame_count, uint8_t slot_count,
+                          uint8_t sample_size, void* const* channels);
+void i2s_tdm_interleave(const void* const* channels, uint32_t frame_count, uint8_t slot_count,
+                        uint8_t sample_size, void* frames);
+
+// Playback and capture sharing one clock unit. Both serializers start on the same frame so sample n
+// of rx_buffer was captured while sample n of tx_buffer was played. The two buffers have the same
+// length and block count. callback is called as each capture block fills. By then the playback
+// block with the same index has been sent and can be refilled.
+typedef struct {
+    i2s_stream_t tx;
+    i2s_stream_t rx;
+} i2s_duplex_t;
+
+int32_t i2s_duplex_init(i2s_duplex_t* duplex, uint8_t clock_unit, uint8_t tx_serializer,
+                        uint8_t rx_serializer, const i2s_format_t* format, void* tx_buffer,
+                        void* rx_buffer, uint32_t length, uint8_t block_count,
+                        dma_ring_callback_t callback, void* callback_data);
+void i2s_duplex_start(i2s_duplex_t* duplex);
+void i2s_duplex_stop(i2s_duplex_t* duplex);
+void i2s_duplex_deinit(i2s_duplex_t* duplex);
 
 #endif  // MICROPY_INCLUDED_ATMEL_SAMD_I2S_H
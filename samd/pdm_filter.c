@@ -0,0 +1,200 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Scott Shawcroft for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "samd/pdm_filter.h"
+
+#include <string.h>
+
+#ifdef SAM_D5X_E5X
+#include "include/sam.h"
+#ifdef __ARM_FEATURE_DSP
+#define PDM_FILTER_USE_DSP
+#endif
+#endif
+
+// Windowed sinc lowpass in Q15 with its cutoff at 0.45 of the output rate. The taps sum to 32768.
+static const int16_t fir_coefficients[PDM_FILTER_FIR_TAPS] __attribute__((aligned(4))) = {
+    0, 3, 3, -29, -34, 91, 155, -172, -470, 178, 1118, 128, -2352, -1436, 5708, 13493,
+    13493, 5708, -1436, -2352, 128, 1118, 178, -470, -172, 155, 91, -34, -29, 3, 3, 0
+};
+
+// The CIC has a gain of 32^4, which is 20 bits. Keep 15 of them.
+#define CIC_SHIFT (5 * PDM_FILTER_CIC_ORDER - 15)
+
+void pdm_filter_init(pdm_filter_t* filter) {
+    memset(filter, 0, sizeof(pdm_filter_t));
+}
+
+static int16_t saturate16(int32_t value) {
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return value;
+}
+
+// What four bits add to each integrator when they all start at zero, indexed by the bits with the
+// oldest one highest. A one is +1 and a zero is -1.
+static const int8_t cic_nibble_steps[16][PDM_FILTER_CIC_ORDER] = {
+    {-4, -10, -20, -35},
+    {-2, -8, -18, -33},
+    {-2, -6, -14, -27},
+    {0, -4, -12, -25},
+    {-2, -4, -8, -15},
+    {0, -2, -6, -13},
+    {0, 0, -2, -7},
+    {2, 2, 0, -5},
+    {-2, -2, 0, 5},
+    {0, 0, 2, 7},
+    {0, 2, 6, 13},
+    {2, 4, 8, 15},
+    {0, 4, 12, 25},
+    {2, 6, 14, 27},
+    {2, 8, 18, 33},
+    {4, 10, 20, 35},
+};
+
+// Run 16 bits through the integrators four at a time. Over four steps each integrator also picks
+// up 4, 10 and 20 times the earlier stages' starting values. The integrators wrap and the combs
+// undo it.
+static void cic_integrate(pdm_filter_t* filter, uint16_t bits) {
+    uint32_t i0 = filter->integrators[0];
+    uint32_t i1 = filter->integrators[1];
+    uint32_t i2 = filter->integrators[2];
+    uint32_t i3 = filter->integrators[3];
+    for (int8_t shift = 12; shift >= 0; shift -= 4) {
+        const int8_t* steps = cic_nibble_steps[(bits >> shift) & 0xf];
+        i3 += 4 * i2 + 10 * i1 + 20 * i0 + steps[3];
+        i2 += 4 * i1 + 10 * i0 + steps[2];
+        i1 += 4 * i0 + steps[1];
+        i0 += steps[0];
+    }
+    filter->integrators[0] = i0;
+    filter->integrators[1] = i1;
+    filter->integrators[2] = i2;
+    filter->integrators[3] = i3;
+}
+
+static int16_t cic_comb(pdm_filter_t* filter) {
+    uint32_t value = filter->integrators[PDM_FILTER_CIC_ORDER - 1];
+    for (uint8_t i = 0; i < PDM_FILTER_CIC_ORDER; i++) {
+        uint32_t previous = filter->combs[i];
+        filter->combs[i] = value;
+        value -= previous;
+    }
+    return saturate16((int32_t) value >> CIC_SHIFT);
+}
+
+#ifdef PDM_FILTER_USE_DSP
+static int32_t fir(const int16_t* taps) {
+    int32_t sum = 0;
+    for (uint8_t i = 0; i < PDM_FILTER_FIR_TAPS; i += 2) {
+        uint32_t samples;
+        uint32_t coefficients;
+        memcpy(&samples, taps + i, sizeof(samples));
+        memcpy(&coefficients, fir_coefficients + i, sizeof(coefficients));
+        sum = __SMLAD(samples, coefficients, sum);
+    }
+    return sum;
+}
+#else
+static int32_t fir(const int16_t* taps) {
+    int32_t sum = 0;
+    for (uint8_t i = 0; i < PDM_FILTER_FIR_TAPS; i++) {
+        sum += taps[i] * fir_coefficients[i];
+    }
+    return sum;
+}
+#endif
+
+// Take the next 16 bits and write a sample to pcm when they complete one. Returns how many it
+// wrote.
+static uint32_t pdm_filter_take(pdm_filter_t* filter, uint16_t bits, int16_t* pcm) {
+    cic_integrate(filter, bits);
+    filter->cic_phase++;
+    // Two halfwords are 32 bits, which is one CIC output.
+    if ((filter->cic_phase & 1) != 0) {
+        return 0;
+    }
+    int16_t sample = cic_comb(filter);
+    uint8_t index = filter->history_index;
+    filter->history[index] = sample;
+    filter->history[index + PDM_FILTER_FIR_TAPS] = sample;
+    index++;
+    if (index == PDM_FILTER_FIR_TAPS) {
+        index = 0;
+    }
+    filter->history_index = index;
+    // Every other CIC output is one FIR output. index is even then so the taps are word
+    // aligned for the DSP path.
+    if ((filter->cic_phase & 3) != 0) {
+        return 0;
+    }
+    *pcm = saturate16(fir(filter->history + index) >> 15);
+    filter->cic_phase = 0;
+    return 1;
+}
+
+uint32_t pdm_filter_run(pdm_filter_t* filter, const uint32_t* words, uint32_t word_count, bool right,
+                        int16_t* pcm) {
+    uint8_t shift = right ? 0 : 16;
+    uint32_t produced = 0;
+    for (uint32_t w = 0; w < word_count; w++) {
+        produced += pdm_filter_take(filter, words[w] >> shift, pcm + produced);
+    }
+    return produced;
+}
+
+uint32_t pdm_filter_run_stereo(pdm_filter_t* left, pdm_filter_t* right, const uint32_t* words,
+                               uint32_t word_count, int16_t* left_pcm, int16_t* right_pcm) {
+    uint32_t produced = 0;
+    for (uint32_t w = 0; w < word_count; w++) {
+        uint32_t word = words[w];
+        pdm_filter_take(left, word >> 16, left_pcm + produced);
+        produced += pdm_filter_take(right, word, right_pcm + produced);
+    }
+    return produced;
+}
+
+#ifdef SAM_D5X_E5X
+uint32_t pdm_filter_cycles_per_sample(const uint32_t* words, uint32_t word_count) {
+    pdm_filter_t filter;
+    pdm_filter_init(&filter);
+    // Small batches so the measurement doesn't need a big output buffer.
+    int16_t pcm[4];
+    uint32_t produced = 0;
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    uint32_t start = DWT->CYCCNT;
+    for (uint32_t w = 0; w + 16 <= word_count; w += 16) {
+        produced += pdm_filter_run(&filter, words + w, 16, false, pcm);
+    }
+    uint32_t cycles = DWT->CYCCNT - start;
+    return produced > 0 ? cycles / produced : 0;
+}
+#endif
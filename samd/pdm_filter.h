@@ -0,0 +1,71 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Scott Shawcroft for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MICROPY_INCLUDED_ATMEL_SAMD_PDM_FILTER_H
+#define MICROPY_INCLUDED_ATMEL_SAMD_PDM_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Turns a PDM bitstream into 16-bit PCM. A fourth order CIC decimates by 32 and a 32 tap lowpass
+// FIR decimates by 2 more, so there are 64 PDM bits per PCM sample. Nothing here touches the
+// hardware so it builds anywhere. On the SAMD51 the FIR uses the M4's dual multiply accumulate.
+
+#define PDM_FILTER_OVERSAMPLING 64
+#define PDM_FILTER_CIC_ORDER 4
+#define PDM_FILTER_FIR_TAPS 32
+
+typedef struct {
+    uint32_t integrators[PDM_FILTER_CIC_ORDER];
+    uint32_t combs[PDM_FILTER_CIC_ORDER];
+    // Each sample is stored twice so the newest taps are always contiguous.
+    int16_t history[2 * PDM_FILTER_FIR_TAPS];
+    uint8_t history_index;
+    // Halfwords the CIC has taken since its last output.
+    uint8_t cic_phase;
+} pdm_filter_t;
+
+void pdm_filter_init(pdm_filter_t* filter);
+
+// Filter word_count words as received from the I2S in PDM2 mode. Each word holds 16 bits of the
+// left microphone in its upper half and 16 of the right one in its lower half, oldest bit first.
+// Use one filter per microphone. Writes word_count / 4 samples to pcm, with any leftover carried
+// into the next call, and returns how many it wrote.
+uint32_t pdm_filter_run(pdm_filter_t* filter, const uint32_t* words, uint32_t word_count, bool right,
+                        int16_t* pcm);
+
+// Same as running pdm_filter_run() for both microphones but reads each word once. Both filters
+// must have taken the same number of words so far.
+uint32_t pdm_filter_run_stereo(pdm_filter_t* left, pdm_filter_t* right, const uint32_t* words,
+                               uint32_t word_count, int16_t* left_pcm, int16_t* right_pcm);
+
+#ifdef SAM_D5X_E5X
+// Times pdm_filter_run() on one microphone of words with the cycle counter and returns the CPU
+// cycles it took per output sample. Uses its own filter and whole multiples of 16 words.
+uint32_t pdm_filter_cycles_per_sample(const uint32_t* words, uint32_t word_count);
+#endif
+
+#endif  // MICROPY_INCLUDED_ATMEL_SAMD_PDM_FILTER_H
@@ -24,10 +24,24 @@
  * THE SOFTWARE.
  */
 
+#include "samd/adc.h"
+
 #include "hal/include/hal_adc_sync.h"
 #include "hpl/gclk/hpl_gclk_base.h"
 #include "hri_mclk.h"
 
+#include "samd/dma.h"
+#include "samd/events.h"
+
+typedef struct {
+    uint8_t biasrefbuf;
+    uint8_t biasr2r;
+    uint8_t biascomp;
+    bool loaded;
+} adc_calibration_t;
+
+static adc_calibration_t calibrations[2];
+
 // Do initialization and calibration setup needed for any use of the ADC.
 // The reference and resolution should be set by the caller.
 void samd_peripherals_adc_setup(struct adc_sync_descriptor *adc, Adc *instance) {
@@ -43,19 +57,298 @@ void samd_peripherals_adc_setup(struct adc_sync_descriptor *adc, Adc *instance)
     adc_sync_init(adc, instance, (void *)NULL);
 
     // SAMD51 has a CALIB register but doesn't have documented fuses for them.
-    uint8_t biasrefbuf;
-    uint8_t biasr2r;
-    uint8_t biascomp;
-    if (instance == ADC0) {
-        biasrefbuf = ((*(uint32_t*) ADC0_FUSES_BIASREFBUF_ADDR) & ADC0_FUSES_BIASREFBUF_Msk) >> ADC0_FUSES_BIASREFBUF_Pos;
-        biasr2r = ((*(uint32_t*) ADC0_FUSES_BIASR2R_ADDR) & ADC0_FUSES_BIASR2R_Msk) >> ADC0_FUSES_BIASR2R_Pos;
-        biascomp = ((*(uint32_t*) ADC0_FUSES_BIASCOMP_ADDR) & ADC0_FUSES_BIASCOMP_Msk) >> ADC0_FUSES_BIASCOMP_Pos;
+    // The fuses never change so only read them the first time.
+    adc_calibration_t* calibration = &calibrations[instance == ADC0 ? 0 : 1];
+    if (!calibration->loaded) {
+        if (instance == ADC0) {
+            calibration->biasrefbuf = ((*(uint32_t*) ADC0_FUSES_BIASREFBUF_ADDR) & ADC0_FUSES_BIASREFBUF_Msk) >> ADC0_FUSES_BIASREFBUF_Pos;
+            calibration->biasr2r = ((*(uint32_t*) ADC0_FUSES_BIASR2R_ADDR) & ADC0_FUSES_BIASR2R_Msk) >> ADC0_FUSES_BIASR2R_Pos;
+            calibration->biascomp = ((*(uint32_t*) ADC0_FUSES_BIASCOMP_ADDR) & ADC0_FUSES_BIASCOMP_Msk) >> ADC0_FUSES_BIASCOMP_Pos;
+        } else {
+            calibration->biasrefbuf = ((*(uint32_t*) ADC1_FUSES_BIASREFBUF_ADDR) & ADC1_FUSES_BIASREFBUF_Msk) >> ADC1_FUSES_BIASREFBUF_Pos;
+            calibration->biasr2r = ((*(uint32_t*) ADC1_FUSES_BIASR2R_ADDR) & ADC1_FUSES_BIASR2R_Msk) >> ADC1_FUSES_BIASR2R_Pos;
+            calibration->biascomp = ((*(uint32_t*) ADC1_FUSES_BIASCOMP_ADDR) & ADC1_FUSES_BIASCOMP_Msk) >> ADC1_FUSES_BIASCOMP_Pos;
+        }
+        calibration->loaded = true;
+    }
+    hri_adc_write_CALIB_BIASREFBUF_bf(instance, calibration->biasrefbuf);
+    hri_adc_write_CALIB_BIASR2R_bf(instance, calibration->biasr2r);
+    hri_adc_write_CALIB_BIASCOMP_bf(instance, calibration->biascomp);
+}
+
+static void adc_sync(Adc* instance) {
+    while (instance->SYNCBUSY.reg != 0) {}
+}
+
+// A slave ADC takes its clock, triggers and enable from ADC0 so it skips those.
+static int32_t adc_stream_setup(adc_stream_t* stream, Adc* instance, const adc_stream_config_t* config,
+                                void* buffer, uint32_t length, uint8_t block_count, uint16_t beat_size, bool slave,
+                                dma_ring_callback_t callback, void* callback_data) {
+    stream->instance = instance;
+    stream->event_channel = slave ? ADC_STREAM_FREE_RUNNING : config->event_channel;
+    stream->dma_channel = dma_allocate_non_audio_channel();
+    if (stream->dma_channel == NO_DMA_CHANNEL) {
+        return DMA_FAILURE_NO_CHANNEL_AVAILABLE;
+    }
+    int32_t result = dma_ring_init(&stream->ring, stream->dma_channel,
+                                   instance == ADC0 ? ADC0_DMAC_ID_RESRDY : ADC1_DMAC_ID_RESRDY,
+                                   buffer, length, block_count, beat_size,
+                                   &instance->RESULT.reg, false, callback, callback_data);
+    if (result != 0) {
+        dma_free_channel(stream->dma_channel);
+        stream->dma_channel = NO_DMA_CHANNEL;
+        return result;
+    }
+
+    samd_peripherals_adc_setup(&stream->adc, instance);
+
+    // PRESCALER and SLAVEEN are enable protected.
+    instance->CTRLA.bit.ENABLE = false;
+    adc_sync(instance);
+    if (slave) {
+        instance->CTRLA.bit.SLAVEEN = true;
+    } else {
+        instance->CTRLA.bit.PRESCALER = config->prescaler;
+    }
+    instance->REFCTRL.reg = ADC_REFCTRL_REFSEL(config->reference);
+    instance->INPUTCTRL.reg = ADC_INPUTCTRL_MUXNEG_GND | ADC_INPUTCTRL_MUXPOS(config->input);
+    instance->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(config->sample_length);
+    uint16_t ctrlb = ADC_CTRLB_WINMODE(config->window_mode);
+    ctrlb |= adc_set_averaging(instance, config->averaging, config->resolution);
+    instance->WINLT.reg = config->window_lower;
+    instance->WINUT.reg = config->window_upper;
+    instance->EVCTRL.reg = 0;
+    // The slave converts whenever ADC0 does so it never free runs or takes start events itself.
+    if (!slave && config->event_channel == ADC_STREAM_FREE_RUNNING) {
+        ctrlb |= ADC_CTRLB_FREERUN;
+    } else if (!slave) {
+        instance->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+        connect_event_user_to_channel(instance == ADC0 ? EVSYS_ID_USER_ADC0_START : EVSYS_ID_USER_ADC1_START,
+                                      config->event_channel);
+    }
+    instance->CTRLB.reg = ctrlb;
+    adc_sync(instance);
+
+    return 0;
+}
+
+int32_t adc_stream_init(adc_stream_t* stream, Adc* instance, const adc_stream_config_t* config,
+                        uint16_t* buffer, uint32_t sample_count, uint8_t block_count,
+                        dma_ring_callback_t callback, void* callback_data) {
+    return adc_stream_setup(stream, instance, config, buffer, sample_count * sizeof(uint16_t), block_count,
+                            DMAC_BTCTRL_BEATSIZE_HWORD, false, callback, callback_data);
+}
+
+void adc_stream_start(adc_stream_t* stream) {
+    Adc* instance = stream->instance;
+    dma_ring_start(&stream->ring);
+    instance->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_OVERRUN | ADC_INTFLAG_WINMON;
+    instance->CTRLA.bit.ENABLE = true;
+    adc_sync(instance);
+    if (stream->event_channel == ADC_STREAM_FREE_RUNNING) {
+        instance->SWTRIG.reg = ADC_SWTRIG_START;
+    }
+}
+
+void adc_stream_stop(adc_stream_t* stream) {
+    stream->instance->CTRLA.bit.ENABLE = false;
+    adc_sync(stream->instance);
+    dma_ring_stop(&stream->ring);
+}
+
+void adc_stream_deinit(adc_stream_t* stream) {
+    if (stream->dma_channel == NO_DMA_CHANNEL) {
+        return;
+    }
+    adc_stream_stop(stream);
+    dma_ring_deinit(&stream->ring);
+    dma_free_channel(stream->dma_channel);
+    stream->dma_channel = NO_DMA_CHANNEL;
+    if (stream->event_channel != ADC_STREAM_FREE_RUNNING) {
+        disable_event_user(stream->instance == ADC0 ? EVSYS_ID_USER_ADC0_START : EVSYS_ID_USER_ADC1_START);
+    }
+    adc_sync_deinit(&stream->adc);
+}
+
+bool adc_stream_window_hit(adc_stream_t* stream) {
+    bool hit = stream->instance->INTFLAG.bit.WINMON;
+    if (hit) {
+        stream->instance->INTFLAG.reg = ADC_INTFLAG_WINMON;
+    }
+    return hit;
+}
+
+bool adc_stream_overrun(adc_stream_t* stream) {
+    bool overrun = stream->instance->INTFLAG.bit.OVERRUN;
+    if (overrun) {
+        stream->instance->INTFLAG.reg = ADC_INTFLAG_OVERRUN;
+    }
+    return overrun;
+}
+
+// Each ADC has its own ring over the same buffer. The rings skip every other halfword so ADC0
+// fills the even samples and ADC1 the odd ones.
+int32_t adc_dual_stream_init(adc_dual_stream_t* dual, const adc_stream_config_t* config0,
+                             const adc_stream_config_t* config1, uint16_t* buffer, uint32_t pair_count,
+                             uint8_t block_count, dma_ring_callback_t callback, void* callback_data) {
+    uint32_t length = pair_count * 2 * sizeof(uint16_t);
+    uint16_t beat_size = DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_STEPSIZE(DMAC_BTCTRL_STEPSIZE_X2_Val);
+    int32_t result = adc_stream_setup(&dual->slave, ADC1, config1, buffer + 1, length, block_count, beat_size, true,
+                                      NULL, NULL);
+    if (result != 0) {
+        return result;
+    }
+    result = adc_stream_setup(&dual->master, ADC0, config0, buffer, length, block_count, beat_size, false,
+                              callback, callback_data);
+    if (result != 0) {
+        adc_stream_deinit(&dual->slave);
+        return result;
+    }
+    // Both ADCs start each conversion together.
+    ADC0->CTRLA.bit.DUALSEL = ADC_CTRLA_DUALSEL_BOTH_Val;
+    adc_sync(ADC0);
+    return 0;
+}
+
+void adc_dual_stream_start(adc_dual_stream_t* dual) {
+    // Enabling and triggering ADC0 does the same to ADC1.
+    dma_ring_start(&dual->slave.ring);
+    ADC1->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_OVERRUN | ADC_INTFLAG_WINMON;
+    adc_stream_start(&dual->master);
+}
+
+void adc_dual_stream_stop(adc_dual_stream_t* dual) {
+    adc_stream_stop(&dual->master);
+    dma_ring_stop(&dual->slave.ring);
+}
+
+void adc_dual_stream_deinit(adc_dual_stream_t* dual) {
+    adc_dual_stream_stop(dual);
+    // Reset the slave first so it stops following ADC0.
+    adc_stream_deinit(&dual->slave);
+    adc_stream_deinit(&dual->master);
+}
+
+void adc_context_init(adc_context_t* context, Adc* instance, uint8_t reference, uint8_t resolution,
+                      uint8_t prescaler, uint8_t sample_length) {
+    context->instance = instance;
+    context->resolution = resolution;
+    samd_peripherals_adc_setup(&context->adc, instance);
+
+    instance->CTRLA.bit.ENABLE = false;
+    adc_sync(instance);
+    instance->CTRLA.bit.PRESCALER = prescaler;
+    instance->REFCTRL.reg = ADC_REFCTRL_REFSEL(reference);
+    instance->INPUTCTRL.reg = ADC_INPUTCTRL_MUXNEG_GND;
+    instance->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(sample_length);
+    instance->AVGCTRL.reg = 0;
+    instance->CTRLB.bit.RESSEL = resolution;
+    instance->CTRLA.bit.ENABLE = true;
+    adc_sync(instance);
+}
+
+void adc_context_select(adc_context_t* context, uint8_t input) {
+    context->instance->INPUTCTRL.bit.MUXPOS = input;
+    adc_sync(context->instance);
+}
+
+uint16_t adc_context_read(adc_context_t* context) {
+    Adc* instance = context->instance;
+    instance->SWTRIG.reg = ADC_SWTRIG_START;
+    while (instance->INTFLAG.bit.RESRDY == 0) {}
+    // Reading RESULT clears RESRDY.
+    return instance->RESULT.reg;
+}
+
+void adc_context_deinit(adc_context_t* context) {
+    adc_sync_deinit(&context->adc);
+}
+
+int32_t adc_scan_init(adc_scan_t* scan, Adc* instance, const adc_stream_config_t* config,
+                      const mcu_pin_obj_t* const* pins, uint8_t pin_count,
+                      uint16_t* buffer, uint32_t round_count, uint8_t block_count,
+                      dma_ring_callback_t callback, void* callback_data) {
+    if (pin_count == 0 || pin_count > ADC_SCAN_MAX_INPUTS ||
+        block_count == 0 || round_count % block_count != 0) {
+        return DMA_FAILURE_INVALID_LENGTH;
+    }
+    uint8_t adc_index = instance == ADC0 ? 0 : 1;
+    for (uint8_t i = 0; i < pin_count; i++) {
+        uint8_t input = pins[i]->adc_input[adc_index];
+        // 0xff is NO_ADC.
+        if (input == 0xff) {
+            return ADC_FAILURE_INVALID_INPUT;
+        }
+        scan->sequence[i] = ADC_INPUTCTRL_MUXNEG_GND | ADC_INPUTCTRL_MUXPOS(input);
+    }
+    scan->input_count = pin_count;
+
+    scan->sequence_channel = dma_allocate_non_audio_channel();
+    if (scan->sequence_channel == NO_DMA_CHANNEL) {
+        return DMA_FAILURE_NO_CHANNEL_AVAILABLE;
+    }
+    int32_t result = dma_ring_init(&scan->sequence_ring, scan->sequence_channel,
+                                   instance == ADC0 ? ADC0_DMAC_ID_SEQ : ADC1_DMAC_ID_SEQ,
+                                   scan->sequence, pin_count * sizeof(uint32_t), 1, DMAC_BTCTRL_BEATSIZE_WORD,
+                                   &instance->DSEQDATA.reg, true, NULL, NULL);
+    if (result == 0) {
+        result = adc_stream_setup(&scan->stream, instance, config, buffer,
+                                  round_count * pin_count * sizeof(uint16_t), block_count,
+                                  DMAC_BTCTRL_BEATSIZE_HWORD, false, callback, callback_data);
+    }
+    if (result != 0) {
+        dma_ring_deinit(&scan->sequence_ring);
+        dma_free_channel(scan->sequence_channel);
+        scan->sequence_channel = NO_DMA_CHANNEL;
+        return result;
+    }
+
+    // Only INPUTCTRL comes from the sequence. Without a trigger event every sequence write
+    // starts the next conversion instead of FREERUN.
+    instance->CTRLB.bit.FREERUN = false;
+    uint32_t dseqctrl = ADC_DSEQCTRL_INPUTCTRL;
+    if (config->event_channel == ADC_STREAM_FREE_RUNNING) {
+        dseqctrl |= ADC_DSEQCTRL_AUTOSTART;
+    }
+    instance->DSEQCTRL.reg = dseqctrl;
+    adc_sync(instance);
+    return 0;
+}
+
+void adc_scan_start(adc_scan_t* scan) {
+    Adc* instance = scan->stream.instance;
+    dma_ring_start(&scan->stream.ring);
+    dma_ring_start(&scan->sequence_ring);
+    instance->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_OVERRUN | ADC_INTFLAG_WINMON;
+    // The ADC asks for the first sequence as soon as it is enabled.
+    instance->CTRLA.bit.ENABLE = true;
+    adc_sync(instance);
+}
+
+void adc_scan_stop(adc_scan_t* scan) {
+    adc_stream_stop(&scan->stream);
+    dma_ring_stop(&scan->sequence_ring);
+}
+
+void adc_scan_deinit(adc_scan_t* scan) {
+    if (scan->sequence_channel == NO_DMA_CHANNEL) {
+        return;
+    }
+    adc_scan_stop(scan);
+    scan->stream.instance->DSEQCTRL.reg = 0;
+    dma_ring_deinit(&scan->sequence_ring);
+    dma_free_channel(scan->sequence_channel);
+    scan->sequence_channel = NO_DMA_CHANNEL;
+    adc_stream_deinit(&scan->stream);
+}
+
+void adc_context_set_oversampling(adc_context_t* context, uint8_t bits) {
+    Adc* instance = context->instance;
+    if (bits > 12) {
+        instance->CTRLB.bit.RESSEL = adc_set_averaging(instance, 0, bits) >> ADC_CTRLB_RESSEL_Pos;
     } else {
-        biasrefbuf = ((*(uint32_t*) ADC1_FUSES_BIASREFBUF_ADDR) & ADC1_FUSES_BIASREFBUF_Msk) >> ADC1_FUSES_BIASREFBUF_Pos;
-        biasr2r = ((*(uint32_t*) ADC1_FUSES_BIASR2R_ADDR) & ADC1_FUSES_BIASR2R_Msk) >> ADC1_FUSES_BIASR2R_Pos;
-        biascomp = ((*(uint32_t*) ADC1_FUSES_BIASCOMP_ADDR) & ADC1_FUSES_BIASCOMP_Msk) >> ADC1_FUSES_BIASCOMP_Pos;
+        adc_set_averaging(instance, 0, 0);
+        instance->CTRLB.bit.RESSEL = context->resolution;
     }
-    hri_adc_write_CALIB_BIASREFBUF_bf(instance, biasrefbuf);
-    hri_adc_write_CALIB_BIASR2R_bf(instance, biasr2r);
-    hri_adc_write_CALIB_BIASCOMP_bf(instance, biascomp);
+    adc_sync(instance);
 }
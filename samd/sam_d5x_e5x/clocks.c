@@ -74,6 +74,29 @@ void disable_clock_generator(uint8_t gclk) {
     while ((GCLK->SYNCBUSY.vec.GENCTRL & (1 << gclk)) != 0) {}
 }
 
+uint8_t find_free_dpll(void) {
+    if (OSCCTRL->Dpll[1].DPLLCTRLA.bit.ENABLE) {
+        return 0xff;
+    }
+    return GCLK_GENCTRL_SRC_DPLL1_Val;
+}
+
+void enable_dpll(uint8_t source, uint8_t reference_gclk, uint16_t multiplier) {
+    uint8_t index = source - GCLK_GENCTRL_SRC_DPLL0_Val;
+    connect_gclk_to_peripheral(reference_gclk, OSCCTRL_GCLK_ID_FDPLL0 + index);
+    OSCCTRL->Dpll[index].DPLLRATIO.reg = OSCCTRL_DPLLRATIO_LDRFRAC(0) | OSCCTRL_DPLLRATIO_LDR(multiplier - 1);
+    OSCCTRL->Dpll[index].DPLLCTRLB.reg = OSCCTRL_DPLLCTRLB_REFCLK(OSCCTRL_DPLLCTRLB_REFCLK_GCLK_Val);
+    OSCCTRL->Dpll[index].DPLLCTRLA.reg = OSCCTRL_DPLLCTRLA_ENABLE;
+    while (!(OSCCTRL->Dpll[index].DPLLSTATUS.bit.LOCK || OSCCTRL->Dpll[index].DPLLSTATUS.bit.CLKRDY)) {}
+}
+
+void disable_dpll(uint8_t source) {
+    uint8_t index = source - GCLK_GENCTRL_SRC_DPLL0_Val;
+    OSCCTRL->Dpll[index].DPLLCTRLA.reg = 0;
+    while (OSCCTRL->Dpll[index].DPLLSYNCBUSY.bit.ENABLE) {}
+    GCLK->PCHCTRL[OSCCTRL_GCLK_ID_FDPLL0 + index].reg = 0;
+}
+
 static void init_clock_source_osculp32k(void) {
     // Calibration value is loaded at startup
     OSC32KCTRL->OSCULP32K.bit.EN1K = 0;
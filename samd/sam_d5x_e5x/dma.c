@@ -34,6 +34,8 @@
 
 #include "shared-bindings/microcontroller/__init__.h"
 
+static uint8_t channel_priority[DMA_CHANNEL_COUNT];
+
 uint8_t sercom_index(Sercom* sercom) {
     const Sercom* sercoms[SERCOM_INST_NUM] = SERCOM_INSTS;
     for (uint8_t i = 0; i < SERCOM_INST_NUM; i++) {
@@ -51,11 +53,42 @@ void dma_configure(uint8_t channel_number, uint8_t trigsrc, bool output_event) {
     if (output_event) {
         channel->CHEVCTRL.reg = DMAC_CHEVCTRL_EVOE;
     }
+    channel->CHPRILVL.reg = DMAC_CHPRILVL_PRILVL(channel_priority[channel_number]);
     channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(trigsrc) |
                            DMAC_CHCTRLA_TRIGACT_BURST |
                            DMAC_CHCTRLA_BURSTLEN_SINGLE;
 }
 
+void dma_configure_software(uint8_t channel_number) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    channel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    channel->CHPRILVL.reg = DMAC_CHPRILVL_PRILVL(channel_priority[channel_number]);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(0) |
+                           DMAC_CHCTRLA_TRIGACT_TRANSACTION |
+                           DMAC_CHCTRLA_BURSTLEN_SINGLE;
+}
+
+void dma_configure_event_input(uint8_t channel_number, uint8_t event_action, bool block_per_event) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    if (block_per_event) {
+        channel->CHCTRLA.bit.TRIGACT = DMAC_CHCTRLA_TRIGACT_BLOCK_Val;
+    }
+    // Keep EVOE if dma_configure() set it.
+    channel->CHEVCTRL.reg = (channel->CHEVCTRL.reg & DMAC_CHEVCTRL_EVOE) |
+                            DMAC_CHEVCTRL_EVIE |
+                            DMAC_CHEVCTRL_EVACT(event_action);
+}
+
+void dma_set_channel_priority(uint8_t channel_number, uint8_t level) {
+    if (level >= DMA_PRIORITY_LEVEL_COUNT) {
+        return;
+    }
+    channel_priority[channel_number] = level;
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    channel->CHPRILVL.reg = DMAC_CHPRILVL_PRILVL(level);
+}
+
 void dma_enable_channel(uint8_t channel_number) {
     DmacChannel* channel = &DMAC->Channel[channel_number];
     channel->CHCTRLA.bit.ENABLE = true;
@@ -89,6 +122,21 @@ uint8_t dma_transfer_status(uint8_t channel_number) {
     return channel->CHINTFLAG.reg;
 }
 
+void dma_enable_channel_interrupts(uint8_t channel_number, uint8_t interrupt_flags) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    channel->CHINTENSET.reg = interrupt_flags;
+}
+
+void dma_disable_channel_interrupts(uint8_t channel_number) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    channel->CHINTENCLR.reg = DMAC_CHINTENCLR_MASK;
+}
+
+void dma_clear_channel_interrupts(uint8_t channel_number, uint8_t interrupt_flags) {
+    DmacChannel* channel = &DMAC->Channel[channel_number];
+    channel->CHINTFLAG.reg = interrupt_flags;
+}
+
 bool dma_channel_free(uint8_t channel_number) {
     DmacChannel* channel = &DMAC->Channel[channel_number];
     return channel->CHSTATUS.reg == 0;
@@ -39,6 +39,11 @@ void turn_on_i2s(void) {
     connect_gclk_to_peripheral(5, I2S_GCLK_ID_1);
 }
 
+void turn_on_i2s_clock_unit(uint8_t clock_unit) {
+    hri_mclk_set_APBDMASK_I2S_bit(MCLK);
+    connect_gclk_to_peripheral(5, I2S_GCLK_ID_0 + clock_unit);
+}
+
 void i2s_set_serializer_enable(uint8_t serializer, bool enable) {
     if (serializer == 0) {
         while (I2S->SYNCBUSY.bit.TXEN == 1) {}
@@ -50,3 +55,69 @@ void i2s_set_serializer_enable(uint8_t serializer, bool enable) {
         while (I2S->SYNCBUSY.bit.RXEN == 1) {}
     }
 }
+
+bool i2s_configure_serializer(uint8_t serializer, uint8_t clock_unit, bool tx, uint8_t datasize, bool mono) {
+    // The transmitter always runs from clock unit 0 and the receiver picks one.
+    if (tx != (serializer == 0) || (tx && clock_unit != 0)) {
+        return false;
+    }
+    // TXCTRL and RXCTRL can only change while their serializer is off.
+    i2s_set_serializer_enable(serializer, false);
+    if (tx) {
+        uint32_t txctrl = I2S_TXCTRL_DATASIZE(datasize) | I2S_TXCTRL_DMA_SINGLE;
+        if (mono) {
+            txctrl |= I2S_TXCTRL_MONO_MONO;
+        }
+        I2S->TXCTRL.reg = txctrl;
+    } else {
+        uint32_t rxctrl = I2S_RXCTRL_DATASIZE(datasize) | I2S_RXCTRL_DMA_SINGLE | I2S_RXCTRL_SERMODE_RX;
+        if (clock_unit == 1) {
+            rxctrl |= I2S_RXCTRL_CLKSEL_CLK1;
+        }
+        if (mono) {
+            rxctrl |= I2S_RXCTRL_SLOTDIS1;
+        }
+        I2S->RXCTRL.reg = rxctrl;
+    }
+    return true;
+}
+
+volatile uint32_t* i2s_serializer_data_register(uint8_t serializer, bool tx) {
+    if (tx) {
+        return &I2S->TXDATA.reg;
+    }
+    return &I2S->RXDATA.reg;
+}
+
+uint8_t i2s_serializer_dma_trigger(uint8_t serializer, bool tx) {
+    if (tx) {
+        return I2S_DMAC_ID_TX_0;
+    }
+    return I2S_DMAC_ID_RX_0;
+}
+
+void i2s_set_duplex_enable(uint8_t clock_unit, uint8_t tx_serializer, uint8_t rx_serializer, bool enable) {
+    // Serializer 0 always transmits and 1 always receives. SYNCBUSY has the same bit for each
+    // enable as CTRLA.
+    uint8_t mask = (I2S_CTRLA_CKEN0 << clock_unit) | I2S_CTRLA_TXEN | I2S_CTRLA_RXEN;
+    while ((I2S->SYNCBUSY.reg & mask) != 0) {}
+    if (enable) {
+        I2S->CTRLA.reg |= mask;
+    } else {
+        I2S->CTRLA.reg &= ~mask;
+    }
+    while ((I2S->SYNCBUSY.reg & mask) != 0) {}
+}
+
+bool i2s_configure_pdm_serializer(uint8_t serializer, uint8_t clock_unit) {
+    if (serializer != 1) {
+        return false;
+    }
+    i2s_set_serializer_enable(serializer, false);
+    uint32_t rxctrl = I2S_RXCTRL_SERMODE_PDM2 | I2S_RXCTRL_DATASIZE(I2S_DATASIZE_32) | I2S_RXCTRL_DMA_SINGLE;
+    if (clock_unit == 1) {
+        rxctrl |= I2S_RXCTRL_CLKSEL_CLK1;
+    }
+    I2S->RXCTRL.reg = rxctrl;
+    return true;
+}
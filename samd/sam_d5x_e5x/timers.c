@@ -34,6 +34,7 @@
 #include "hri_gclk.h"
 
 const uint8_t tcc_cc_num[5] = {6, 4, 3, 2, 2};
+const uint8_t tcc_counter_bits[5] = {24, 24, 16, 16, 16};
 const uint8_t tc_gclk_ids[TC_INST_NUM] = {TC0_GCLK_ID,
                                           TC1_GCLK_ID,
                                           TC2_GCLK_ID,
@@ -24,10 +24,19 @@
  * THE SOFTWARE.
  */
 
+#include "samd/adc.h"
+
 #include "hal/include/hal_adc_sync.h"
 #include "hpl/gclk/hpl_gclk_base.h"
 #include "hpl/pm/hpl_pm_base.h"
 
+#include "samd/dma.h"
+#include "samd/events.h"
+
+static bool calibration_loaded = false;
+static uint8_t bias_calibration;
+static uint16_t linearity_calibration;
+
 // Do initialization and calibration setup needed for any use of the ADC.
 // The reference and resolution should be set by the caller.
 void samd_peripherals_adc_setup(struct adc_sync_descriptor *adc, Adc *instance) {
@@ -37,11 +46,170 @@ void samd_peripherals_adc_setup(struct adc_sync_descriptor *adc, Adc *instance)
 
     adc_sync_init(adc, instance, (void *)NULL);
 
-    // Load the factory calibration
-    hri_adc_write_CALIB_BIAS_CAL_bf(ADC, (*((uint32_t*) ADC_FUSES_BIASCAL_ADDR) & ADC_FUSES_BIASCAL_Msk) >> ADC_FUSES_BIASCAL_Pos);
-    // Bits 7:5
-    uint16_t linearity = ((*((uint32_t*) ADC_FUSES_LINEARITY_1_ADDR) & ADC_FUSES_LINEARITY_1_Msk) >> ADC_FUSES_LINEARITY_1_Pos) << 5;
-    // Bits 4:0
-    linearity |= (*((uint32_t*) ADC_FUSES_LINEARITY_0_ADDR) & ADC_FUSES_LINEARITY_0_Msk) >> ADC_FUSES_LINEARITY_0_Pos;
-    hri_adc_write_CALIB_LINEARITY_CAL_bf(ADC, linearity);
+    // Load the factory calibration. The fuses never change so only read them the first time.
+    if (!calibration_loaded) {
+        bias_calibration = (*((uint32_t*) ADC_FUSES_BIASCAL_ADDR) & ADC_FUSES_BIASCAL_Msk) >> ADC_FUSES_BIASCAL_Pos;
+        // Bits 7:5
+        linearity_calibration = ((*((uint32_t*) ADC_FUSES_LINEARITY_1_ADDR) & ADC_FUSES_LINEARITY_1_Msk) >> ADC_FUSES_LINEARITY_1_Pos) << 5;
+        // Bits 4:0
+        linearity_calibration |= (*((uint32_t*) ADC_FUSES_LINEARITY_0_ADDR) & ADC_FUSES_LINEARITY_0_Msk) >> ADC_FUSES_LINEARITY_0_Pos;
+        calibration_loaded = true;
+    }
+    hri_adc_write_CALIB_BIAS_CAL_bf(ADC, bias_calibration);
+    hri_adc_write_CALIB_LINEARITY_CAL_bf(ADC, linearity_calibration);
+}
+
+static void adc_sync(Adc* instance) {
+    while (instance->STATUS.bit.SYNCBUSY == 1) {}
+}
+
+// VDDANA/2 only covers the whole input range with the matching 1/2 gain.
+static uint32_t adc_input_gain(uint8_t reference) {
+    if (reference == ADC_REFCTRL_REFSEL_INTVCC1_Val) {
+        return ADC_INPUTCTRL_GAIN_DIV2;
+    }
+    return ADC_INPUTCTRL_GAIN_1X;
+}
+
+int32_t adc_stream_init(adc_stream_t* stream, Adc* instance, const adc_stream_config_t* config,
+                        uint16_t* buffer, uint32_t sample_count, uint8_t block_count,
+                        dma_ring_callback_t callback, void* callback_data) {
+    stream->instance = instance;
+    stream->event_channel = config->event_channel;
+    stream->dma_channel = dma_allocate_non_audio_channel();
+    if (stream->dma_channel == NO_DMA_CHANNEL) {
+        return DMA_FAILURE_NO_CHANNEL_AVAILABLE;
+    }
+    int32_t result = dma_ring_init(&stream->ring, stream->dma_channel, ADC_DMAC_ID_RESRDY,
+                                   buffer, sample_count * sizeof(uint16_t), block_count, DMAC_BTCTRL_BEATSIZE_HWORD,
+                                   &instance->RESULT.reg, false, callback, callback_data);
+    if (result != 0) {
+        dma_free_channel(stream->dma_channel);
+        stream->dma_channel = NO_DMA_CHANNEL;
+        return result;
+    }
+
+    samd_peripherals_adc_setup(&stream->adc, instance);
+
+    instance->CTRLA.bit.ENABLE = false;
+    adc_sync(instance);
+    instance->REFCTRL.reg = ADC_REFCTRL_REFSEL(config->reference);
+    instance->INPUTCTRL.reg = adc_input_gain(config->reference) | ADC_INPUTCTRL_MUXNEG_GND |
+                              ADC_INPUTCTRL_MUXPOS(config->input);
+    adc_sync(instance);
+    instance->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(config->sample_length);
+    uint16_t ctrlb = ADC_CTRLB_PRESCALER(config->prescaler);
+    ctrlb |= adc_set_averaging(instance, config->averaging, config->resolution);
+    instance->WINCTRL.reg = ADC_WINCTRL_WINMODE(config->window_mode);
+    adc_sync(instance);
+    instance->WINLT.reg = config->window_lower;
+    adc_sync(instance);
+    instance->WINUT.reg = config->window_upper;
+    adc_sync(instance);
+    if (config->event_channel == ADC_STREAM_FREE_RUNNING) {
+        ctrlb |= ADC_CTRLB_FREERUN;
+        instance->EVCTRL.reg = 0;
+    } else {
+        instance->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+        connect_event_user_to_channel(EVSYS_ID_USER_ADC_START, config->event_channel);
+    }
+    instance->CTRLB.reg = ctrlb;
+    adc_sync(instance);
+
+    return 0;
+}
+
+void adc_stream_start(adc_stream_t* stream) {
+    Adc* instance = stream->instance;
+    dma_ring_start(&stream->ring);
+    instance->INTFLAG.reg = ADC_INTFLAG_RESRDY | ADC_INTFLAG_OVERRUN | ADC_INTFLAG_WINMON;
+    instance->CTRLA.bit.ENABLE = true;
+    adc_sync(instance);
+    if (stream->event_channel == ADC_STREAM_FREE_RUNNING) {
+        instance->SWTRIG.reg = ADC_SWTRIG_START;
+        adc_sync(instance);
+    }
+}
+
+void adc_stream_stop(adc_stream_t* stream) {
+    stream->instance->CTRLA.bit.ENABLE = false;
+    adc_sync(stream->instance);
+    dma_ring_stop(&stream->ring);
+}
+
+void adc_stream_deinit(adc_stream_t* stream) {
+    if (stream->dma_channel == NO_DMA_CHANNEL) {
+        return;
+    }
+    adc_stream_stop(stream);
+    dma_ring_deinit(&stream->ring);
+    dma_free_channel(stream->dma_channel);
+    stream->dma_channel = NO_DMA_CHANNEL;
+    if (stream->event_channel != ADC_STREAM_FREE_RUNNING) {
+        disable_event_user(EVSYS_ID_USER_ADC_START);
+    }
+    adc_sync_deinit(&stream->adc);
+}
+
+bool adc_stream_window_hit(adc_stream_t* stream) {
+    bool hit = stream->instance->INTFLAG.bit.WINMON;
+    if (hit) {
+        stream->instance->INTFLAG.reg = ADC_INTFLAG_WINMON;
+    }
+    return hit;
+}
+
+bool adc_stream_overrun(adc_stream_t* stream) {
+    bool overrun = stream->instance->INTFLAG.bit.OVERRUN;
+    if (overrun) {
+        stream->instance->INTFLAG.reg = ADC_INTFLAG_OVERRUN;
+    }
+    return overrun;
+}
+
+void adc_context_init(adc_context_t* context, Adc* instance, uint8_t reference, uint8_t resolution,
+                      uint8_t prescaler, uint8_t sample_length) {
+    context->instance = instance;
+    context->resolution = resolution;
+    samd_peripherals_adc_setup(&context->adc, instance);
+
+    instance->CTRLA.bit.ENABLE = false;
+    adc_sync(instance);
+    instance->REFCTRL.reg = ADC_REFCTRL_REFSEL(reference);
+    instance->INPUTCTRL.reg = adc_input_gain(reference) | ADC_INPUTCTRL_MUXNEG_GND;
+    adc_sync(instance);
+    instance->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(sample_length);
+    instance->AVGCTRL.reg = 0;
+    instance->CTRLB.reg = ADC_CTRLB_PRESCALER(prescaler) | (resolution << ADC_CTRLB_RESSEL_Pos);
+    adc_sync(instance);
+    instance->CTRLA.bit.ENABLE = true;
+    adc_sync(instance);
+}
+
+void adc_context_select(adc_context_t* context, uint8_t input) {
+    context->instance->INPUTCTRL.bit.MUXPOS = input;
+    adc_sync(context->instance);
+}
+
+uint16_t adc_context_read(adc_context_t* context) {
+    Adc* instance = context->instance;
+    instance->SWTRIG.reg = ADC_SWTRIG_START;
+    while (instance->INTFLAG.bit.RESRDY == 0) {}
+    // Reading RESULT clears RESRDY.
+    return instance->RESULT.reg;
+}
+
+void adc_context_deinit(adc_context_t* context) {
+    adc_sync_deinit(&context->adc);
+}
+
+void adc_context_set_oversampling(adc_context_t* context, uint8_t bits) {
+    Adc* instance = context->instance;
+    if (bits > 12) {
+        instance->CTRLB.bit.RESSEL = adc_set_averaging(instance, 0, bits) >> ADC_CTRLB_RESSEL_Pos;
+    } else {
+        adc_set_averaging(instance, 0, 0);
+        instance->CTRLB.bit.RESSEL = context->resolution;
+    }
+    adc_sync(instance);
 }
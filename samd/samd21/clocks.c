@@ -75,6 +75,27 @@ void disable_clock_generator(uint8_t gclk) {
     while (GCLK->STATUS.bit.SYNCBUSY != 0) {}
 }
 
+uint8_t find_free_dpll(void) {
+    if (SYSCTRL->DPLLCTRLA.bit.ENABLE) {
+        return 0xff;
+    }
+    return GCLK_GENCTRL_SRC_FDPLL_Val;
+}
+
+void enable_dpll(uint8_t source, uint8_t reference_gclk, uint16_t multiplier) {
+    connect_gclk_to_peripheral(reference_gclk, SYSCTRL_GCLK_ID_FDPLL);
+    SYSCTRL->DPLLRATIO.reg = SYSCTRL_DPLLRATIO_LDRFRAC(0) | SYSCTRL_DPLLRATIO_LDR(multiplier - 1);
+    SYSCTRL->DPLLCTRLB.reg = SYSCTRL_DPLLCTRLB_REFCLK_GCLK;
+    SYSCTRL->DPLLCTRLA.reg = SYSCTRL_DPLLCTRLA_ENABLE;
+    while (!(SYSCTRL->DPLLSTATUS.bit.LOCK && SYSCTRL->DPLLSTATUS.bit.CLKRDY)) {}
+}
+
+void disable_dpll(uint8_t source) {
+    SYSCTRL->DPLLCTRLA.reg = 0;
+    while (SYSCTRL->DPLLSTATUS.bit.ENABLE) {}
+    disconnect_gclk_from_peripheral(0, SYSCTRL_GCLK_ID_FDPLL);
+}
+
 static void init_clock_source_osc8m(void) {
     // Preserve CALIB and FRANGE
     SYSCTRL->OSC8M.bit.ONDEMAND = 0;
@@ -34,6 +34,8 @@
 
 #include "shared-bindings/microcontroller/__init__.h"
 
+static uint8_t channel_priority[DMA_CHANNEL_COUNT];
+
 uint8_t sercom_index(Sercom* sercom) {
     return ((uint32_t) sercom - (uint32_t) SERCOM0) / 0x400;
 }
@@ -49,13 +51,48 @@ void dma_configure(uint8_t channel_number, uint8_t trigsrc, bool output_event) {
     if (output_event) {
         event_output_enable = DMAC_CHCTRLB_EVOE;
     }
-    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL_LVL0 |
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(channel_priority[channel_number]) |
             DMAC_CHCTRLB_TRIGSRC(trigsrc) |
             DMAC_CHCTRLB_TRIGACT_BEAT |
             event_output_enable;
     common_hal_mcu_enable_interrupts();
 }
 
+void dma_configure_software(uint8_t channel_number) {
+    common_hal_mcu_disable_interrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel_number);
+    DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    DMAC->SWTRIGCTRL.reg &= (uint32_t)(~(1 << channel_number));
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(channel_priority[channel_number]) |
+            DMAC_CHCTRLB_TRIGSRC(0) |
+            DMAC_CHCTRLB_TRIGACT_TRANSACTION;
+    common_hal_mcu_enable_interrupts();
+}
+
+void dma_configure_event_input(uint8_t channel_number, uint8_t event_action, bool block_per_event) {
+    common_hal_mcu_disable_interrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel_number);
+    if (block_per_event) {
+        DMAC->CHCTRLB.bit.TRIGACT = DMAC_CHCTRLB_TRIGACT_BLOCK_Val;
+    }
+    DMAC->CHCTRLB.reg = (DMAC->CHCTRLB.reg & ~DMAC_CHCTRLB_EVACT_Msk) |
+            DMAC_CHCTRLB_EVIE |
+            DMAC_CHCTRLB_EVACT(event_action);
+    common_hal_mcu_enable_interrupts();
+}
+
+void dma_set_channel_priority(uint8_t channel_number, uint8_t level) {
+    if (level >= DMA_PRIORITY_LEVEL_COUNT) {
+        return;
+    }
+    channel_priority[channel_number] = level;
+    common_hal_mcu_disable_interrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel_number);
+    DMAC->CHCTRLB.bit.LVL = level;
+    common_hal_mcu_enable_interrupts();
+}
+
 void dma_enable_channel(uint8_t channel_number) {
     common_hal_mcu_disable_interrupts();
     DMAC->CHID.reg = DMAC_CHID_ID(channel_number);
@@ -103,6 +140,27 @@ uint8_t dma_transfer_status(uint8_t channel_number) {
     return status;
 }
 
+void dma_enable_channel_interrupts(uint8_t channel_number, uint8_t interrupt_flags) {
+    common_hal_mcu_disable_interrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel_number);
+    DMAC->CHINTENSET.reg = interrupt_flags;
+    common_hal_mcu_enable_interrupts();
+}
+
+void dma_disable_channel_interrupts(uint8_t channel_number) {
+    common_hal_mcu_disable_interrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel_number);
+    DMAC->CHINTENCLR.reg = DMAC_CHINTENCLR_MASK;
+    common_hal_mcu_enable_interrupts();
+}
+
+void dma_clear_channel_interrupts(uint8_t channel_number, uint8_t interrupt_flags) {
+    common_hal_mcu_disable_interrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel_number);
+    DMAC->CHINTFLAG.reg = interrupt_flags;
+    common_hal_mcu_enable_interrupts();
+}
+
 bool dma_channel_free(uint8_t channel_number) {
     common_hal_mcu_disable_interrupts();
     DMAC->CHID.reg = DMAC_CHID_ID(channel_number);
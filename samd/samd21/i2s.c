@@ -35,12 +35,73 @@ void turn_on_i2s(void) {
     _pm_enable_bus_clock(PM_BUS_APBC, I2S);
 }
 
+void turn_on_i2s_clock_unit(uint8_t clock_unit) {
+    turn_on_i2s();
+}
+
 void i2s_set_serializer_enable(uint8_t serializer, bool enable) {
     while ((I2S->SYNCBUSY.vec.SEREN & (1 << serializer)) != 0) {}
     if (enable) {
-        I2S->CTRLA.vec.SEREN = 1 << serializer;
+        I2S->CTRLA.vec.SEREN |= 1 << serializer;
     } else {
         I2S->CTRLA.vec.SEREN &= ~(1 << serializer);
     }
     while ((I2S->SYNCBUSY.vec.SEREN & (1 << serializer)) != 0) {}
 }
+
+bool i2s_configure_serializer(uint8_t serializer, uint8_t clock_unit, bool tx, uint8_t datasize, bool mono) {
+    // SERCTRL can only change while the serializer is off.
+    i2s_set_serializer_enable(serializer, false);
+    uint32_t serctrl = I2S_SERCTRL_DATASIZE(datasize) | I2S_SERCTRL_DMA_SINGLE;
+    if (clock_unit == 1) {
+        serctrl |= I2S_SERCTRL_CLKSEL_CLK1;
+    }
+    if (tx) {
+        serctrl |= I2S_SERCTRL_SERMODE_TX;
+        if (mono) {
+            serctrl |= I2S_SERCTRL_MONO_MONO;
+        }
+    } else {
+        serctrl |= I2S_SERCTRL_SERMODE_RX;
+        if (mono) {
+            serctrl |= I2S_SERCTRL_SLOTDIS1;
+        }
+    }
+    I2S->SERCTRL[serializer].reg = serctrl;
+    return true;
+}
+
+volatile uint32_t* i2s_serializer_data_register(uint8_t serializer, bool tx) {
+    return &I2S->DATA[serializer].reg;
+}
+
+uint8_t i2s_serializer_dma_trigger(uint8_t serializer, bool tx) {
+    if (tx) {
+        return I2S_DMAC_ID_TX_0 + serializer;
+    }
+    return I2S_DMAC_ID_RX_0 + serializer;
+}
+
+void i2s_set_duplex_enable(uint8_t clock_unit, uint8_t tx_serializer, uint8_t rx_serializer, bool enable) {
+    // SYNCBUSY has the same bit for each enable as CTRLA.
+    uint8_t mask = (I2S_CTRLA_CKEN0 << clock_unit) |
+                   (I2S_CTRLA_SEREN0 << tx_serializer) |
+                   (I2S_CTRLA_SEREN0 << rx_serializer);
+    while ((I2S->SYNCBUSY.reg & mask) != 0) {}
+    if (enable) {
+        I2S->CTRLA.reg |= mask;
+    } else {
+        I2S->CTRLA.reg &= ~mask;
+    }
+    while ((I2S->SYNCBUSY.reg & mask) != 0) {}
+}
+
+bool i2s_configure_pdm_serializer(uint8_t serializer, uint8_t clock_unit) {
+    i2s_set_serializer_enable(serializer, false);
+    uint32_t serctrl = I2S_SERCTRL_SERMODE_PDM2 | I2S_SERCTRL_DATASIZE(I2S_DATASIZE_32) | I2S_SERCTRL_DMA_SINGLE;
+    if (clock_unit == 1) {
+        serctrl |= I2S_SERCTRL_CLKSEL_CLK1;
+    }
+    I2S->SERCTRL[serializer].reg = serctrl;
+    return true;
+}
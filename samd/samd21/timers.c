@@ -34,6 +34,7 @@
 #include "hpl/gclk/hpl_gclk_base.h"
 
 const uint8_t tcc_cc_num[3] = {4, 2, 2};
+const uint8_t tcc_counter_bits[3] = {24, 24, 16};
 const uint8_t tc_gclk_ids[TC_INST_NUM] = {TC3_GCLK_ID,
                TC4_GCLK_ID,
                TC5_GCLK_ID,
@@ -25,6 +25,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "timers.h"
@@ -61,16 +62,129 @@ IRQn_Type const tc_irq[TC_INST_NUM] = {
 #endif
 };
 
+#ifdef SAM_D5X_E5X
+#define TC_OFFSET 0
+#endif
+#ifdef SAMD21
+#define TC_OFFSET 3
+#endif
+
+// Timers handed out by timer_reserve(). A 32-bit TC also holds the next TC, which is marked in
+// tc_paired.
+static uint8_t tc_reserved = 0;
+static uint8_t tc_paired = 0;
+static uint8_t tcc_reserved = 0;
+
 uint8_t find_free_timer(void) {
     int8_t index = TC_INST_NUM - 1;
     for (; index >= 0; index--) {
-        if (tc_insts[index]->COUNT16.CTRLA.bit.ENABLE == 0) {
+        if (tc_insts[index]->COUNT16.CTRLA.bit.ENABLE == 0 && (tc_reserved & (1 << index)) == 0) {
             return index;
         }
     }
     return 0xff;
 }
 
+static bool tc_available(uint8_t index) {
+    return (tc_reserved & (1 << index)) == 0 && tc_insts[index]->COUNT16.CTRLA.bit.ENABLE == 0;
+}
+
+static bool tcc_available(uint8_t index) {
+    return (tcc_reserved & (1 << index)) == 0 && tcc_insts[index]->CTRLA.bit.ENABLE == 0;
+}
+
+// How much of the timer would go unused. TCs cost nothing so they are always used first and TCCs
+// cost more the more channels and bits they have. Returns 0xffff if the timer doesn't fit.
+static uint16_t timer_cost(const timer_requirements_t* requirements, bool is_tc, uint8_t index) {
+    if (is_tc) {
+        if (index >= TC_INST_NUM || requirements->cc_count > 2 || requirements->bits > 32 ||
+            !tc_available(index)) {
+            return 0xffff;
+        }
+        // 32 bits chains an even TC with the odd one after it.
+        if (requirements->bits > 16 &&
+            ((index + TC_OFFSET) % 2 != 0 || index + 1 >= TC_INST_NUM || !tc_available(index + 1))) {
+            return 0xffff;
+        }
+        return 0;
+    }
+    if (index >= TCC_INST_NUM || requirements->cc_count > tcc_cc_num[index] ||
+        requirements->bits > tcc_counter_bits[index] || !tcc_available(index)) {
+        return 0xffff;
+    }
+    return tcc_cc_num[index] * 32 + tcc_counter_bits[index];
+}
+
+bool timer_reserve(const timer_requirements_t* requirements, pin_timer_t* timer) {
+    uint16_t best_cost = 0xffff;
+    if (requirements->wave_outputs != NULL) {
+        for (uint8_t i = 0; i < requirements->wave_output_count; i++) {
+            const pin_timer_t* output = &requirements->wave_outputs[i];
+            uint16_t cost = timer_cost(requirements, output->is_tc, output->index);
+            if (cost < best_cost) {
+                best_cost = cost;
+                *timer = *output;
+            }
+        }
+    } else {
+        // Go from the end like find_free_timer() so the two don't collide more than they need to.
+        for (int8_t index = TC_INST_NUM - 1; index >= 0 && best_cost != 0; index--) {
+            if (timer_cost(requirements, true, index) == 0) {
+                best_cost = 0;
+                timer->is_tc = true;
+                timer->index = index;
+                timer->wave_output = 0;
+            }
+        }
+        for (uint8_t index = 0; index < TCC_INST_NUM; index++) {
+            uint16_t cost = timer_cost(requirements, false, index);
+            if (cost < best_cost) {
+                best_cost = cost;
+                timer->is_tc = false;
+                timer->index = index;
+                timer->wave_output = 0;
+            }
+        }
+    }
+    if (best_cost == 0xffff) {
+        return false;
+    }
+    if (!timer->is_tc) {
+        tcc_reserved |= 1 << timer->index;
+    } else if (requirements->bits > 16) {
+        tc_reserved |= 3 << timer->index;
+        tc_paired |= 1 << timer->index;
+    } else {
+        tc_reserved |= 1 << timer->index;
+    }
+    return true;
+}
+
+void timer_release(const pin_timer_t* timer) {
+    if (!timer->is_tc) {
+        tcc_reserved &= ~(1 << timer->index);
+        return;
+    }
+    if ((tc_paired & (1 << timer->index)) != 0) {
+        tc_paired &= ~(1 << timer->index);
+        tc_reserved &= ~(2 << timer->index);
+    }
+    tc_reserved &= ~(1 << timer->index);
+}
+
+bool timer_is_reserved(bool is_tc, uint8_t index) {
+    if (is_tc) {
+        return (tc_reserved & (1 << index)) != 0;
+    }
+    return (tcc_reserved & (1 << index)) != 0;
+}
+
+void reset_timer_reservations(void) {
+    tc_reserved = 0;
+    tc_paired = 0;
+    tcc_reserved = 0;
+}
+
 void tc_enable_interrupts(uint8_t tc_index) {
     NVIC_DisableIRQ(tc_irq[tc_index]);
     NVIC_ClearPendingIRQ(tc_irq[tc_index]);
@@ -95,13 +209,6 @@ void tc_reset(Tc* tc) {
     }
 }
 
-#ifdef SAM_D5X_E5X
-#define TC_OFFSET 0
-#endif
-#ifdef SAMD21
-#define TC_OFFSET 3
-#endif
-
 void TCC0_Handler(void) {
     shared_timer_handler(false, 0);
 }
@@ -29,15 +29,19 @@
 #include <stdbool.h>
 #include "include/sam.h"
 
+#include "shared-bindings/microcontroller/Pin.h"
+
 extern const uint16_t prescaler[8];
 
 #ifdef SAMD21
 extern const uint8_t tcc_cc_num[3];
+extern const uint8_t tcc_counter_bits[3];
 extern const uint8_t tc_gclk_ids[TC_INST_NUM];
 extern const uint8_t tcc_gclk_ids[3];
 #endif
 #ifdef SAM_D5X_E5X
 extern const uint8_t tcc_cc_num[5];
+extern const uint8_t tcc_counter_bits[5];
 extern const uint8_t tc_gclk_ids[TC_INST_NUM];
 extern const uint8_t tcc_gclk_ids[TCC_INST_NUM];
 #endif
@@ -51,6 +55,26 @@ void tc_wait_for_sync(Tc* tc);
 void tc_reset(Tc* tc);
 uint8_t find_free_timer(void);
 
+// What a timer must be able to do for timer_reserve().
+typedef struct {
+    // Smallest counter width in bits. 32 takes a pair of TCs.
+    uint8_t bits;
+    // Compare channels needed.
+    uint8_t cc_count;
+    // If not NULL, the timer must drive one of these, such as the timer[] of a pin.
+    const pin_timer_t* wave_outputs;
+    uint8_t wave_output_count;
+} timer_requirements_t;
+
+// Reserve the free timer that fits the requirements with the least to spare and describe it in
+// timer. A TC is always picked over a TCC when one fits. Reserved timers stay taken while disabled
+// until timer_release(). Timers enabled by code that doesn't reserve are skipped too. Returns false
+// if nothing fits.
+bool timer_reserve(const timer_requirements_t* requirements, pin_timer_t* timer);
+void timer_release(const pin_timer_t* timer);
+bool timer_is_reserved(bool is_tc, uint8_t index);
+void reset_timer_reservations(void);
+
 void tc_enable_interrupts(uint8_t tc_index);
 void tc_disable_interrupts(uint8_t tc_index);
 
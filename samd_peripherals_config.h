@@ -39,4 +39,26 @@
 // example, CircuitPython uses this to add the Python type info into the struct.
 #define PIN_PREFIX_VALUES
 
+// DMA channels reserved for audio as a bit per channel. Defaults to the first
+// AUDIO_DMA_CHANNEL_COUNT (4) channels.
+// #define DMA_AUDIO_CHANNEL_MASK 0x0000000f
+
+// DMA priority level (0 - 3) that audio channels start at. Other channels start at 0.
+// #define DMA_AUDIO_PRIORITY_LEVEL 2
+
+// Number of extra descriptors shared by all DMA channels for chained transfers.
+// #define DMA_LINKED_DESCRIPTOR_COUNT 16
+
+// Polls without progress before a blocking DMA transfer times out.
+// #define DMA_WATCHDOG_STALL_POLLS 100000
+
+// Set to 1 to keep DMA transfer counters, latency histograms and a trace of recent transfers.
+// #define DMA_STATISTICS 0
+
+// Number of writes a SERCOM DMA session can have queued, including the running one.
+// #define SERCOM_DMA_SESSION_QUEUE_LENGTH 4
+
+// Shorter dma_memcpy_async() and dma_memset_async() jobs are done by the CPU.
+// #define DMA_MEMORY_MIN_LENGTH 64
+
 #endif // SAMD_PERIPHERALS_CONFIG_H